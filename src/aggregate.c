@@ -0,0 +1,518 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * aggregate.c - temporal aggregation of time series
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "dates.h"
+#include "ts.h"
+#include "aggregate.h"
+#include "threads.h"
+#include "heap.h"
+#include "platform.h"
+
+/* Accumulator of the not-null values of an interval; also counts the null
+ * records, so that the missing values can be determined.
+ */
+struct accumulator {
+    double sum, min, max;
+    int count;
+    int nrecords;
+};
+
+static void acc_clear(struct accumulator *acc)
+{
+    acc->sum = 0.0;
+    acc->min = acc->max = NAN;
+    acc->count = acc->nrecords = 0;
+}
+
+static void acc_add(struct accumulator *acc, const struct ts_record *r)
+{
+    ++(acc->nrecords);
+    if(r->null)
+        return;
+    acc->sum += r->value;
+    acc->min = fmin(acc->min, r->value);
+    acc->max = fmax(acc->max, r->value);
+    ++(acc->count);
+}
+
+static double acc_result(const struct accumulator *acc, int function)
+{
+    switch(function) {
+        case TS_AGG_SUM:   return acc->sum;
+        case TS_AGG_MEAN:  return acc->sum / acc->count;
+        case TS_AGG_MIN:   return acc->min;
+        case TS_AGG_MAX:   return acc->max;
+        default:           return acc->count;
+    }
+}
+
+static int is_valid_function(int function)
+{
+    return function >= TS_AGG_SUM && function <= TS_AGG_COUNT;
+}
+
+DLLEXPORT int ts_aggregate(const struct timeseries *source,
+    struct timeseries *dest, const struct timestep *step, int function,
+    int source_step_minutes, double missing_allowed, const char *missing_flag,
+    char **errstr)
+{
+    struct ts_record *r = source->data;
+    struct ts_record *end = source->data + source->nrecords;
+    struct accumulator acc;
+    long_time_t interval_start, interval_end;
+    int expected, missing, null, result, dummy;
+
+    if(!timestep_is_valid(step) || !is_valid_function(function)
+                                                || source_step_minutes < 0) {
+        *errstr = "Invalid aggregation parameters";
+        return EINVAL;
+    }
+    if(!source->nrecords)
+        return 0;
+
+    /* Each destination record is stamped at the end of its interval and
+     * aggregates the source records in (interval_start, interval_end].
+     */
+    interval_end = timestep_up(step, r->timestamp);
+    interval_start = timestep_prev(step, interval_end);
+    while(r < end) {
+        acc_clear(&acc);
+        for(; r < end && r->timestamp <= interval_end; ++r)
+            acc_add(&acc, r);
+        expected = source_step_minutes
+                ? (int) ((interval_end - interval_start)
+                                            / (60LL * source_step_minutes))
+                : acc.nrecords;
+        missing = expected - acc.count;
+        if(missing < 0)
+            missing = 0;
+        null = function == TS_AGG_COUNT ? 0
+               : !acc.count || missing > missing_allowed * expected;
+        if((result = ts_append_record(dest, interval_end, null,
+                    null ? 0.0 : acc_result(&acc, function),
+                    missing && missing_flag ? missing_flag : "",
+                    &dummy, errstr)))
+            return result;
+        interval_start = interval_end;
+        interval_end = timestep_next(step, interval_end);
+    }
+    return 0;
+}
+
+/* ts_rolling */
+
+/* Running sum with compensation (Neumaier), so that subtracting the values
+ * that leave the window does not accumulate rounding errors.
+ */
+static void running_add(double *sum, double *err, double x)
+{
+    double t = *sum + x;
+    if(fabs(*sum) >= fabs(x))
+        *err += (*sum - t) + x;
+    else
+        *err += (x - t) + *sum;
+    *sum = t;
+}
+
+/* A monotonic deque of record indexes; values at the indexes from head to
+ * tail are increasing (for min; decreasing for max), so the extreme of the
+ * window is at head.
+ */
+struct deque {
+    int *items;
+    int head, tail;   /* Items are head..tail-1 */
+};
+
+static void deque_push(struct deque *dq, const struct ts_record *data, int i,
+                                                                    int sign)
+{
+    while(dq->tail > dq->head
+            && sign * data[dq->items[dq->tail-1]].value >= sign * data[i].value)
+        --(dq->tail);
+    dq->items[(dq->tail)++] = i;
+}
+
+static void deque_expire(struct deque *dq, int first)
+{
+    while(dq->tail > dq->head && dq->items[dq->head] < first)
+        ++(dq->head);
+}
+
+DLLEXPORT int ts_rolling(const struct timeseries *source,
+    struct timeseries *dest, long_time_t window, int function, char **errstr)
+{
+    const struct ts_record *data = source->data;
+    struct deque dq;
+    double sum = 0.0, err = 0.0, value = 0.0;
+    int first = 0, count = 0;
+    int i, null, dummy;
+    int sign = function == TS_AGG_MAX ? -1 : 1;
+    int result = 0;
+
+    if(window <= 0 || !is_valid_function(function)) {
+        *errstr = "Invalid rolling window parameters";
+        return EINVAL;
+    }
+    dq.head = dq.tail = 0;
+    dq.items = NULL;
+    if((function == TS_AGG_MIN || function == TS_AGG_MAX) && source->nrecords
+            && !(dq.items = malloc(source->nrecords * sizeof(int)))) {
+        *errstr = strerror(errno);
+        return errno;
+    }
+
+    /* The window of record i consists of the records in
+     * (data[i].timestamp - window, data[i].timestamp], i.e. first..i.
+     */
+    for(i = 0; i < source->nrecords; ++i) {
+        if(!data[i].null) {
+            running_add(&sum, &err, data[i].value);
+            ++count;
+            if(dq.items)
+                deque_push(&dq, data, i, sign);
+        }
+        for(; data[first].timestamp <= data[i].timestamp - window; ++first)
+            if(!data[first].null) {
+                running_add(&sum, &err, -data[first].value);
+                --count;
+            }
+        if(!count)
+            sum = err = 0.0;
+        if(dq.items)
+            deque_expire(&dq, first);
+        null = !count && function != TS_AGG_COUNT;
+        if(!null)
+            switch(function) {
+                case TS_AGG_SUM:   value = sum + err; break;
+                case TS_AGG_MEAN:  value = (sum + err) / count; break;
+                case TS_AGG_COUNT: value = count; break;
+                default:           value = data[dq.items[dq.head]].value;
+            }
+        if((result = ts_append_record(dest, data[i].timestamp, null,
+                                null ? 0.0 : value, "", &dummy, errstr)))
+            break;
+    }
+    free(dq.items);
+    return result;
+}
+
+/* ts_aggregate_intervals */
+
+/* The intervals are answered in a single sweep of the time series. Each
+ * interval is opened when the sweep reaches its start, at which point the
+ * running sums are noted, and closed when the sweep passes its end. For min
+ * and max, a monotonic stack of the records swept so far is kept (values
+ * increasing from bottom to top for min); the minimum of records l..r, when
+ * the sweep is at r, is the value of the lowest stack item with index >= l.
+ */
+
+struct interval_key {
+    long_time_t key;
+    int index;
+};
+
+static int compare_interval_keys(const void *a, const void *b)
+{
+    const struct interval_key *ka = a;
+    const struct interval_key *kb = b;
+    if(ka->key != kb->key)
+        return ka->key < kb->key ? -1 : 1;
+    return ka->index - kb->index;
+}
+
+struct stack {
+    int *items;
+    int n;
+};
+
+static void stack_push(struct stack *st, const struct ts_record *data, int i,
+                                                                    int sign)
+{
+    while(st->n
+            && sign * data[st->items[st->n-1]].value >= sign * data[i].value)
+        --(st->n);
+    st->items[(st->n)++] = i;
+}
+
+static double stack_extreme(const struct stack *st,
+                                    const struct ts_record *data, int first)
+{
+    int low = 0, high = st->n;
+    while(low < high) {
+        int mid = low + (high-low)/2;
+        if(st->items[mid] < first)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low < st->n ? data[st->items[low]].value : NAN;
+}
+
+DLLEXPORT int ts_aggregate_intervals(const struct timeseries *ts,
+    const struct interval_list *intervals, int ops, struct ts_stats *out,
+    char **errstr)
+{
+    const struct ts_record *data = ts->data;
+    struct interval_key *starts = NULL, *ends = NULL;
+    struct stack minstack, maxstack;
+    int *first_record = NULL;
+    double *first_sum = NULL, *first_err = NULL;
+    int *first_count = NULL;
+    double sum = 0.0, err = 0.0;
+    int count = 0;
+    int i, j, is, ie, n = intervals->n;
+    int do_minmax = ops & ((1 << TS_AGG_MIN) | (1 << TS_AGG_MAX));
+    int result = 0;
+
+    minstack.items = maxstack.items = NULL;
+    minstack.n = maxstack.n = 0;
+    if(!n)
+        return 0;
+    if(!(starts = malloc(n * sizeof(struct interval_key)))) goto GENFAIL;
+    if(!(ends = malloc(n * sizeof(struct interval_key)))) goto GENFAIL;
+    if(!(first_record = malloc(n * sizeof(int)))) goto GENFAIL;
+    if(!(first_count = malloc(n * sizeof(int)))) goto GENFAIL;
+    if(!(first_sum = malloc(n * sizeof(double)))) goto GENFAIL;
+    if(!(first_err = malloc(n * sizeof(double)))) goto GENFAIL;
+    if(do_minmax && ts->nrecords) {
+        if(!(minstack.items = malloc(ts->nrecords * sizeof(int))))
+            goto GENFAIL;
+        if(!(maxstack.items = malloc(ts->nrecords * sizeof(int))))
+            goto GENFAIL;
+    }
+    for(j = 0; j < n; ++j) {
+        starts[j].key = intervals->intervals[j].start_date;
+        ends[j].key = intervals->intervals[j].end_date;
+        starts[j].index = ends[j].index = j;
+        first_record[j] = -1;
+    }
+    qsort(starts, n, sizeof(struct interval_key), compare_interval_keys);
+    qsort(ends, n, sizeof(struct interval_key), compare_interval_keys);
+
+    for(i = 0, is = 0, ie = 0; ie < n; ++i) {
+        /* Open the intervals that start at or before record i. */
+        for(; is < n && (i >= ts->nrecords
+                                || starts[is].key <= data[i].timestamp); ++is) {
+            j = starts[is].index;
+            first_record[j] = i;
+            first_sum[j] = sum;
+            first_err[j] = err;
+            first_count[j] = count;
+        }
+        /* Close the intervals that end before record i; they contain
+         * records first_record..i-1.
+         */
+        for(; ie < n && (i >= ts->nrecords
+                                || ends[ie].key < data[i].timestamp); ++ie) {
+            struct ts_stats *o;
+            j = ends[ie].index;
+            o = out + j;
+            o->sum = o->mean = o->min = o->max = NAN;
+            o->count = 0;
+            if(first_record[j] < 0 || first_record[j] >= i)
+                continue;
+            o->count = count - first_count[j];
+            if(!o->count)
+                continue;
+            o->sum = (sum - first_sum[j]) + (err - first_err[j]);
+            o->mean = o->sum / o->count;
+            if(do_minmax) {
+                o->min = stack_extreme(&minstack, data, first_record[j]);
+                o->max = stack_extreme(&maxstack, data, first_record[j]);
+            }
+        }
+        if(i >= ts->nrecords || data[i].null)
+            continue;
+        running_add(&sum, &err, data[i].value);
+        ++count;
+        if(do_minmax) {
+            stack_push(&minstack, data, i, 1);
+            stack_push(&maxstack, data, i, -1);
+        }
+    }
+
+END:
+    free(starts);
+    free(ends);
+    free(first_record);
+    free(first_count);
+    free(first_sum);
+    free(first_err);
+    free(minstack.items);
+    free(maxstack.items);
+    return result;
+
+GENFAIL:
+    result = errno;
+    *errstr = strerror(errno);
+    goto END;
+}
+
+/* tsl_cross_aggregate */
+
+/* The time series are swept simultaneously, in order of timestamp, by a
+ * k-way merge.
+ */
+DLLEXPORT int tsl_cross_aggregate(const struct timeseries_list *tsl,
+    struct timeseries *dest, int function, char **errstr)
+{
+    struct kmerge km;
+    struct accumulator acc;
+    long_time_t t;
+    int i, j, k, null, dummy, result = 0;
+
+    if(!is_valid_function(function)) {
+        *errstr = "Invalid aggregation function";
+        return EINVAL;
+    }
+    if((result = kmerge_init(&km, tsl->n, sizeof(struct ts_record)))) {
+        *errstr = strerror(result);
+        return result;
+    }
+    for(i = 0; i < tsl->n; ++i)
+        if(tsl->ts[i]->nrecords)
+            kmerge_add(&km, i, &tsl->ts[i]->data->timestamp, 0,
+                                                    tsl->ts[i]->nrecords);
+    while((k = kmerge_next(&km, &t))) {
+        acc_clear(&acc);
+        for(j = 0; j < k; ++j) {
+            i = km.sources[j];
+            acc_add(&acc, tsl->ts[i]->data + km.cursor[i]);
+        }
+        null = !acc.count && function != TS_AGG_COUNT;
+        if((result = ts_append_record(dest, t, null,
+                        null ? 0.0 : acc_result(&acc, function), "", &dummy,
+                        errstr)))
+            break;
+    }
+    kmerge_free(&km);
+    return result;
+}
+
+/* Parallel statistics */
+
+/* The records are split in chunks of fixed size, independently of the
+ * number of threads; the partial results of the chunks are then combined
+ * pairwise in a fixed order, so that the sum is the same whatever the
+ * number of threads.
+ */
+#define CHUNK_RECORDS 16384
+
+struct chunk_job {
+    const struct ts_record *first;
+    int nrecords;
+    struct accumulator *partial;
+};
+
+static void chunk_task(void *arg, int i)
+{
+    struct chunk_job *job = arg;
+    const struct ts_record *r = job->first + i * CHUNK_RECORDS;
+    const struct ts_record *end = job->first + job->nrecords;
+    struct accumulator *acc = job->partial + i;
+
+    acc_clear(acc);
+    if(end > r + CHUNK_RECORDS)
+        end = r + CHUNK_RECORDS;
+    for(; r < end; ++r)
+        acc_add(acc, r);
+}
+
+DLLEXPORT int ts_stats_parallel(const struct timeseries *ts,
+    long_time_t start_date, long_time_t end_date, struct ts_stats *out,
+    char **errstr)
+{
+    struct ts_record *r = ts_get_next(ts, start_date);
+    struct ts_record *end = ts_get_prev(ts, end_date);
+    struct chunk_job job;
+    struct accumulator *p;
+    int nchunks, step, i;
+
+    out->sum = out->mean = out->min = out->max = NAN;
+    out->count = 0;
+    if(!r || !end || r>end)
+        return 0;
+    job.first = r;
+    job.nrecords = end - r + 1;
+    nchunks = (job.nrecords + CHUNK_RECORDS - 1) / CHUNK_RECORDS;
+    if(!(job.partial = malloc(nchunks * sizeof(struct accumulator)))) {
+        *errstr = strerror(errno);
+        return errno;
+    }
+    if(parallel_worthwhile(job.nrecords))
+        parallel_run(nchunks, chunk_task, &job);
+    else
+        for(i = 0; i < nchunks; ++i)
+            chunk_task(&job, i);
+    for(step = 1; step < nchunks; step *= 2)
+        for(i = 0; i + step < nchunks; i += 2 * step) {
+            p = job.partial;
+            p[i].sum += p[i+step].sum;
+            p[i].min = fmin(p[i].min, p[i+step].min);
+            p[i].max = fmax(p[i].max, p[i+step].max);
+            p[i].count += p[i+step].count;
+        }
+    if((out->count = job.partial[0].count)) {
+        out->sum = job.partial[0].sum;
+        out->mean = out->sum / out->count;
+        out->min = job.partial[0].min;
+        out->max = job.partial[0].max;
+    }
+    free(job.partial);
+    return 0;
+}
+
+DLLEXPORT double ts_min_parallel(const struct timeseries *ts,
+    long_time_t start_date, long_time_t end_date)
+{
+    struct ts_stats stats;
+    char *errstr;
+    return ts_stats_parallel(ts, start_date, end_date, &stats, &errstr)
+                                                        ? NAN : stats.min;
+}
+
+DLLEXPORT double ts_max_parallel(const struct timeseries *ts,
+    long_time_t start_date, long_time_t end_date)
+{
+    struct ts_stats stats;
+    char *errstr;
+    return ts_stats_parallel(ts, start_date, end_date, &stats, &errstr)
+                                                        ? NAN : stats.max;
+}
+
+DLLEXPORT double ts_average_parallel(const struct timeseries *ts,
+    long_time_t start_date, long_time_t end_date)
+{
+    struct ts_stats stats;
+    char *errstr;
+    return ts_stats_parallel(ts, start_date, end_date, &stats, &errstr)
+                                                        ? NAN : stats.mean;
+}
+
+DLLEXPORT double ts_sum_parallel(const struct timeseries *ts,
+    long_time_t start_date, long_time_t end_date)
+{
+    struct ts_stats stats;
+    char *errstr;
+    return ts_stats_parallel(ts, start_date, end_date, &stats, &errstr)
+                                                        ? NAN : stats.sum;
+}
@@ -0,0 +1,67 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * aggregate.h - temporal aggregation of time series
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _AGGREGATE_H
+
+#define _AGGREGATE_H
+
+#include "platform.h"
+#include "dates.h"
+#include "ts.h"
+
+/* Aggregation functions */
+#define TS_AGG_SUM 0
+#define TS_AGG_MEAN 1
+#define TS_AGG_MIN 2
+#define TS_AGG_MAX 3
+#define TS_AGG_COUNT 4
+
+/* Bitmask of all aggregation functions, for the ops of
+ * ts_aggregate_intervals; a single one is (1 << TS_AGG_xxx).
+ */
+#define TS_AGG_ALL 0x1f
+
+struct ts_stats {
+    double sum, mean, min, max;
+    int count;
+};
+
+extern DLLEXPORT int ts_aggregate(const struct timeseries *source,
+    struct timeseries *dest, const struct timestep *step, int function,
+    int source_step_minutes, double missing_allowed, const char *missing_flag,
+    char **errstr);
+extern DLLEXPORT int ts_rolling(const struct timeseries *source,
+    struct timeseries *dest, long_time_t window, int function, char **errstr);
+extern DLLEXPORT int ts_aggregate_intervals(const struct timeseries *ts,
+    const struct interval_list *intervals, int ops, struct ts_stats *out,
+    char **errstr);
+extern DLLEXPORT int tsl_cross_aggregate(const struct timeseries_list *tsl,
+    struct timeseries *dest, int function, char **errstr);
+extern DLLEXPORT int ts_stats_parallel(const struct timeseries *ts,
+    long_time_t start_date, long_time_t end_date, struct ts_stats *out,
+    char **errstr);
+extern DLLEXPORT double ts_min_parallel(const struct timeseries *ts,
+    long_time_t start_date, long_time_t end_date);
+extern DLLEXPORT double ts_max_parallel(const struct timeseries *ts,
+    long_time_t start_date, long_time_t end_date);
+extern DLLEXPORT double ts_average_parallel(const struct timeseries *ts,
+    long_time_t start_date, long_time_t end_date);
+extern DLLEXPORT double ts_sum_parallel(const struct timeseries *ts,
+    long_time_t start_date, long_time_t end_date);
+
+#endif /* _AGGREGATE_H */
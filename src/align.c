@@ -0,0 +1,173 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * align.c - alignment of time series on common timestamps
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "dates.h"
+#include "ts.h"
+#include "align.h"
+#include "heap.h"
+#include "threads.h"
+#include "platform.h"
+
+/* Sets m->timestamps and m->nrows by a k-way merge of the time series.
+ * Returns zero or errno.
+ */
+static int merge_timestamps(const struct timeseries_list *tsl, int mode,
+                                                        struct tsl_matrix *m)
+{
+    struct kmerge km;
+    long_time_t t, *p;
+    int i, count, size = 0;
+    int result;
+
+    for(i = 0; i < tsl->n; ++i)
+        if(mode == TSL_ALIGN_UNION)
+            size += tsl->ts[i]->nrecords;
+        else if(!i || tsl->ts[i]->nrecords < size)
+            size = tsl->ts[i]->nrecords;
+    if(!size)
+        return 0;
+    if(!(m->timestamps = malloc(size * sizeof(long_time_t))))
+        return errno;
+    if((result = kmerge_init(&km, tsl->n, sizeof(struct ts_record))))
+        return result;
+    for(i = 0; i < tsl->n; ++i)
+        if(tsl->ts[i]->nrecords)
+            kmerge_add(&km, i, &tsl->ts[i]->data->timestamp, 0,
+                                                    tsl->ts[i]->nrecords);
+    while((count = kmerge_next(&km, &t)))
+        if(mode == TSL_ALIGN_UNION || count == tsl->n)
+            m->timestamps[(m->nrows)++] = t;
+    kmerge_free(&km);
+    /* Give back the unused part */
+    if(m->nrows < size && m->nrows
+            && (p = realloc(m->timestamps, m->nrows * sizeof(long_time_t))))
+        m->timestamps = p;
+    return 0;
+}
+
+/* Fills rows r1..r2-1; each time series fills its column, walking along
+ * the timestamps.
+ */
+static void fill_rows(const struct timeseries_list *tsl, struct tsl_matrix *m,
+                                                            int r1, int r2)
+{
+    int i, j, k;
+
+    for(j = 0; j < m->ncols; ++j) {
+        const struct timeseries *ts = tsl->ts[j];
+        size_t pos = m->layout == TSL_ALIGN_ROW_MAJOR
+                    ? (size_t) r1 * m->ncols + j : (size_t) j * m->nrows + r1;
+        size_t step = m->layout == TSL_ALIGN_ROW_MAJOR ? m->ncols : 1;
+        k = r1 ? ts_get_next_i(ts, m->timestamps[r1]) : 0;
+        if(k < 0)
+            k = ts->nrecords;
+        for(i = r1; i < r2; ++i, pos += step) {
+            while(k < ts->nrecords && ts->data[k].timestamp < m->timestamps[i])
+                ++k;
+            if(k < ts->nrecords && ts->data[k].timestamp == m->timestamps[i]
+                                                    && !ts->data[k].null) {
+                m->values[pos] = ts->data[k].value;
+                m->null[pos] = 0;
+            } else {
+                m->values[pos] = NAN;
+                m->null[pos] = 1;
+            }
+        }
+    }
+}
+
+/* On several threads, each fills a range of rows, so that they do not
+ * write to the same cache lines (except at the range boundaries).
+ */
+struct fill_job {
+    const struct timeseries_list *tsl;
+    struct tsl_matrix *m;
+    int nparts;
+};
+
+static void fill_task(void *arg, int part)
+{
+    struct fill_job *job = arg;
+    long long nrows = job->m->nrows;
+
+    fill_rows(job->tsl, job->m, (int) (nrows * part / job->nparts),
+                                (int) (nrows * (part + 1) / job->nparts));
+}
+
+/* The timestamps are found first, and then the values. */
+DLLEXPORT int tsl_align(const struct timeseries_list *tsl, int mode,
+                        int layout, struct tsl_matrix *m, char **errstr)
+{
+    struct fill_job job;
+    size_t size;
+    int result;
+
+    m->nrows = 0;
+    m->ncols = tsl->n;
+    m->layout = layout;
+    m->timestamps = NULL;
+    m->values = NULL;
+    m->null = NULL;
+    if((mode != TSL_ALIGN_UNION && mode != TSL_ALIGN_INTERSECTION)
+            || (layout != TSL_ALIGN_ROW_MAJOR
+                                    && layout != TSL_ALIGN_COLUMN_MAJOR)) {
+        *errstr = "Invalid alignment mode or layout";
+        return EINVAL;
+    }
+    if((result = merge_timestamps(tsl, mode, m))) {
+        *errstr = strerror(result);
+        tsl_matrix_free(m);
+        return result;
+    }
+    size = (size_t) m->nrows * m->ncols;
+    if(!size)
+        return 0;
+    if(!(m->values = malloc(size * sizeof(double)))
+                                        || !(m->null = malloc(size))) {
+        result = errno;
+        *errstr = strerror(errno);
+        tsl_matrix_free(m);
+        return result;
+    }
+    if(parallel_worthwhile(size > INT_MAX ? INT_MAX : (int) size)) {
+        job.tsl = tsl;
+        job.m = m;
+        job.nparts = dickinson_get_threads();
+        if(job.nparts > m->nrows)
+            job.nparts = m->nrows;
+        parallel_run(job.nparts, fill_task, &job);
+    } else
+        fill_rows(tsl, m, 0, m->nrows);
+    return 0;
+}
+
+DLLEXPORT void tsl_matrix_free(struct tsl_matrix *m)
+{
+    free(m->timestamps);
+    free(m->values);
+    free(m->null);
+    m->timestamps = NULL;
+    m->values = NULL;
+    m->null = NULL;
+    m->nrows = 0;
+}
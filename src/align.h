@@ -0,0 +1,53 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * align.h - alignment of time series on common timestamps
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _ALIGN_H
+
+#define _ALIGN_H
+
+#include "platform.h"
+#include "dates.h"
+#include "ts.h"
+
+/* Which timestamps the rows of the matrix are */
+#define TSL_ALIGN_UNION 0
+#define TSL_ALIGN_INTERSECTION 1
+
+/* Layout of the matrix */
+#define TSL_ALIGN_ROW_MAJOR 0
+#define TSL_ALIGN_COLUMN_MAJOR 1
+
+/* The values of a timeseries_list on common timestamps. Row i is
+ * timestamps[i], and column j is time series j. The element (i, j) is at
+ * i * ncols + j if row major, or at j * nrows + i if column major; null[]
+ * is nonzero where the time series has a null record or no record at that
+ * timestamp, and values[] is then NAN.
+ */
+struct tsl_matrix {
+    int nrows, ncols;
+    int layout;
+    long_time_t *timestamps;
+    double *values;
+    unsigned char *null;
+};
+
+extern DLLEXPORT int tsl_align(const struct timeseries_list *tsl, int mode,
+                        int layout, struct tsl_matrix *m, char **errstr);
+extern DLLEXPORT void tsl_matrix_free(struct tsl_matrix *m);
+
+#endif /* _ALIGN_H */
@@ -0,0 +1,276 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * catalog.c - a collection of time series indexed by id
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "catalog.h"
+#include "ts.h"
+#include "platform.h"
+
+/* The finalizer of MurmurHash3; ids are often consecutive, and this spreads
+ * them over the table.
+ */
+static unsigned hash_id(long long id)
+{
+    unsigned long long x = (unsigned long long) id;
+
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return (unsigned) x;
+}
+
+/* Returns the table position of id, or of the empty entry where it would
+ * go.
+ */
+static int table_position(const struct ts_catalog *cat, long long id)
+{
+    unsigned mask = cat->table_size - 1;
+    unsigned i = hash_id(id) & mask;
+
+    while(cat->table[i] >= 0 && cat->slots[cat->table[i]].id != id)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static int rehash(struct ts_catalog *cat, int table_size)
+{
+    int *table = malloc(table_size*sizeof(int));
+    int i;
+
+    if(!table)
+        return errno;
+    free(cat->table);
+    cat->table = table;
+    cat->table_size = table_size;
+    for(i = 0; i < table_size; ++i)
+        table[i] = -1;
+    for(i = 0; i < cat->list.n; ++i) {
+        int slot = cat->list_slots[i];
+        table[table_position(cat, cat->slots[slot].id)] = slot;
+    }
+    return 0;
+}
+
+DLLEXPORT struct ts_catalog *tsc_create(void)
+{
+    struct ts_catalog *cat;
+
+    if(!(cat = malloc(sizeof(struct ts_catalog))))
+        return NULL;
+    cat->slots = NULL;
+    cat->nslots = 0;
+    cat->size = 0;
+    cat->free_slot = -1;
+    cat->table = NULL;
+    cat->table_size = 0;
+    cat->list.ts = NULL;
+    cat->list.n = 0;
+    cat->list.size = 0;
+    cat->list_slots = NULL;
+    return cat;
+}
+
+DLLEXPORT void tsc_free(struct ts_catalog *cat)
+{
+    int i;
+
+    if(!cat) return;
+    for(i = 0; i < cat->list.n; ++i)
+        ts_free(cat->list.ts[i]);
+    free(cat->slots);
+    free(cat->table);
+    free(cat->list.ts);
+    free(cat->list_slots);
+    free(cat);
+}
+
+/* Makes room for n time series in total, so that adding them does not
+ * allocate memory.
+ */
+DLLEXPORT int tsc_reserve(struct ts_catalog *cat, int n)
+{
+    int table_size = cat->table_size ? cat->table_size : 32;
+    void *p;
+
+    if(n > cat->size) {
+        if(!(p = realloc(cat->slots, n*sizeof(struct tsc_slot))))
+            return errno;
+        cat->slots = p;
+        if(!(p = realloc(cat->list.ts, n*sizeof(struct timeseries *))))
+            return errno;
+        cat->list.ts = p;
+        cat->list.size = n;
+        if(!(p = realloc(cat->list_slots, n*sizeof(int))))
+            return errno;
+        cat->list_slots = p;
+        cat->size = n;
+    }
+    while(table_size < 2*n)
+        table_size *= 2;
+    if(table_size > cat->table_size)
+        return rehash(cat, table_size);
+    return 0;
+}
+
+DLLEXPORT int tsc_add(struct ts_catalog *cat, long long id,
+                    struct timeseries *ts, int *handle, char **errstr)
+{
+    int i, slot, result;
+
+    if(cat->table_size && cat->table[table_position(cat, id)] >= 0) {
+        *errstr = "Duplicate id";
+        return EEXIST;
+    }
+    if(cat->list.n >= cat->size || 2*(cat->list.n + 1) > cat->table_size) {
+        int n = cat->size ? 2*cat->size : 16;
+        if((result = tsc_reserve(cat, n))) {
+            *errstr = strerror(result);
+            return result;
+        }
+    }
+    if(cat->free_slot >= 0) {
+        slot = cat->free_slot;
+        cat->free_slot = cat->slots[slot].pos;
+    } else
+        slot = (cat->nslots)++;
+    i = table_position(cat, id);
+    cat->table[i] = slot;
+    cat->slots[slot].id = id;
+    cat->slots[slot].ts = ts;
+    cat->slots[slot].pos = cat->list.n;
+    cat->list.ts[cat->list.n] = ts;
+    cat->list_slots[(cat->list.n)++] = slot;
+    if(handle)
+        *handle = slot;
+    return 0;
+}
+
+/* Frees the time series. The hash table entry is removed by shifting back
+ * the following entries of its probe sequence, so that no tombstones are
+ * needed.
+ */
+DLLEXPORT int tsc_remove(struct ts_catalog *cat, int handle)
+{
+    unsigned mask, i, j, k;
+    int pos, last;
+
+    if(handle < 0 || handle >= cat->nslots || !cat->slots[handle].ts)
+        return EINVAL;
+    mask = cat->table_size - 1;
+    i = table_position(cat, cat->slots[handle].id);
+    for(j = (i + 1) & mask; cat->table[j] >= 0; j = (j + 1) & mask) {
+        k = hash_id(cat->slots[cat->table[j]].id) & mask;
+        /* Move entry j to i unless its home k is cyclically in (i, j] */
+        if((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+            cat->table[i] = cat->table[j];
+            i = j;
+        }
+    }
+    cat->table[i] = -1;
+
+    pos = cat->slots[handle].pos;
+    last = --(cat->list.n);
+    cat->list.ts[pos] = cat->list.ts[last];
+    cat->list_slots[pos] = cat->list_slots[last];
+    cat->slots[cat->list_slots[pos]].pos = pos;
+
+    ts_free(cat->slots[handle].ts);
+    cat->slots[handle].ts = NULL;
+    cat->slots[handle].pos = cat->free_slot;
+    cat->free_slot = handle;
+    return 0;
+}
+
+/* Returns the handle of id, or -1. */
+DLLEXPORT int tsc_find(const struct ts_catalog *cat, long long id)
+{
+    if(!cat->table_size)
+        return -1;
+    return cat->table[table_position(cat, id)];
+}
+
+DLLEXPORT struct timeseries *tsc_get(const struct ts_catalog *cat,
+                                                                long long id)
+{
+    int handle = tsc_find(cat, id);
+    return handle < 0 ? NULL : cat->slots[handle].ts;
+}
+
+DLLEXPORT struct timeseries *tsc_ts(const struct ts_catalog *cat, int handle)
+{
+    if(handle < 0 || handle >= cat->nslots)
+        return NULL;
+    return cat->slots[handle].ts;
+}
+
+DLLEXPORT long long tsc_id(const struct ts_catalog *cat, int handle)
+{
+    return cat->slots[handle].id;
+}
+
+DLLEXPORT int tsc_length(const struct ts_catalog *cat)
+{
+    return cat->list.n;
+}
+
+/* All the time series, for passing to the functions that operate on a
+ * timeseries_list; valid until the catalog is modified.
+ */
+DLLEXPORT const struct timeseries_list *tsc_list(
+                                            const struct ts_catalog *cat)
+{
+    return &cat->list;
+}
+
+/* Appends to tsl the time series with the given ids. If an id is not in
+ * the catalog, tsl is left as it was.
+ */
+DLLEXPORT int tsc_select(const struct ts_catalog *cat,
+                const long long *ids, int n, struct timeseries_list *tsl,
+                char **errstr)
+{
+    int i, result, n0 = tsl->n;
+    struct timeseries **p;
+
+    if(tsl->n + n > tsl->size) {
+        if(!(p = realloc(tsl->ts, (tsl->n + n)*sizeof(struct timeseries *)))) {
+            *errstr = strerror(errno);
+            return errno;
+        }
+        tsl->ts = p;
+        tsl->size = tsl->n + n;
+    }
+    for(i = 0; i < n; ++i) {
+        int handle = tsc_find(cat, ids[i]);
+        if(handle < 0) {
+            tsl->n = n0;
+            *errstr = "Unknown id";
+            return ENOENT;
+        }
+        if((result = tsl_append(tsl, cat->slots[handle].ts))) {
+            tsl->n = n0;
+            *errstr = strerror(result);
+            return result;
+        }
+    }
+    return 0;
+}
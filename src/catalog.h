@@ -0,0 +1,69 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * catalog.h - a collection of time series indexed by id
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _CATALOG_H
+
+#define _CATALOG_H
+
+#include "platform.h"
+#include "ts.h"
+
+/* The catalog owns its time series. Each one is in a slot, whose number is
+ * its handle; a handle stays valid until the time series is removed, after
+ * which the slot may be reused. The table is an open addressing hash table
+ * (linear probing) of slot numbers by id, at most half full. The list holds
+ * all time series, in no particular order, and list_slots[i] is the slot of
+ * list.ts[i]; removal moves the last time series into the gap.
+ */
+struct tsc_slot {
+    long long id;
+    struct timeseries *ts;  /* NULL if the slot is free */
+    int pos;                /* In the list, or the next free slot */
+};
+
+struct ts_catalog {
+    struct tsc_slot *slots;
+    int nslots;             /* Slots used, including free ones */
+    int size;               /* Number of allocated slots */
+    int free_slot;          /* First free slot, or -1 */
+    int *table;
+    int table_size;         /* Zero or a power of two */
+    struct timeseries_list list;
+    int *list_slots;
+};
+
+extern DLLEXPORT struct ts_catalog *tsc_create(void);
+extern DLLEXPORT void tsc_free(struct ts_catalog *cat);
+extern DLLEXPORT int tsc_reserve(struct ts_catalog *cat, int n);
+extern DLLEXPORT int tsc_add(struct ts_catalog *cat, long long id,
+                    struct timeseries *ts, int *handle, char **errstr);
+extern DLLEXPORT int tsc_remove(struct ts_catalog *cat, int handle);
+extern DLLEXPORT int tsc_find(const struct ts_catalog *cat, long long id);
+extern DLLEXPORT struct timeseries *tsc_get(const struct ts_catalog *cat,
+                                                                long long id);
+extern DLLEXPORT struct timeseries *tsc_ts(const struct ts_catalog *cat,
+                                                                int handle);
+extern DLLEXPORT long long tsc_id(const struct ts_catalog *cat, int handle);
+extern DLLEXPORT int tsc_length(const struct ts_catalog *cat);
+extern DLLEXPORT const struct timeseries_list *tsc_list(
+                                            const struct ts_catalog *cat);
+extern DLLEXPORT int tsc_select(const struct ts_catalog *cat,
+                const long long *ids, int n, struct timeseries_list *tsl,
+                char **errstr);
+
+#endif /* _CATALOG_H */
@@ -661,6 +661,73 @@ void igmtime(long_time_t gm_time, struct tm *tm)
     tm->tm_wday = (delta_days_1970 + 4) % 7;
 }
 
+/* Time steps. Boundaries are numbered, boundary 0 being the one at the
+ * offset; timestep_index returns the number of the first boundary >= t.
+ */
+
+static long long floor_div(long long a, long long b)
+{
+    return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+static long_time_t month_start(long long month)
+{
+    int year = (int) floor_div(month, 12);
+    int mon = (int) (month - 12LL * year);
+    return ydhms_diffl(year-TM_YEAR_BASE, year_days(mon, year), 0, 0, 0,
+                                                            70, 0, 0, 0, 0);
+}
+
+DLLEXPORT long_time_t timestep_boundary(const struct timestep *step,
+                                                                long long k)
+{
+    if(step->length_minutes)
+        return (k * step->length_minutes + step->offset_minutes) * 60;
+    return month_start(k * step->length_months + step->offset_months)
+                                                + step->offset_minutes * 60LL;
+}
+
+DLLEXPORT long long timestep_index(const struct timestep *step, long_time_t t)
+{
+    struct tm tm;
+    long long k;
+
+    if(step->length_minutes)
+        return -floor_div(step->offset_minutes * 60LL - t,
+                                            step->length_minutes * 60LL);
+    igmtime(t, &tm);
+    k = floor_div((tm.tm_year + TM_YEAR_BASE) * 12LL + tm.tm_mon
+                            - step->offset_months, step->length_months);
+    while(timestep_boundary(step, k) < t)
+        ++k;
+    while(timestep_boundary(step, k-1) >= t)
+        --k;
+    return k;
+}
+
+DLLEXPORT int timestep_is_valid(const struct timestep *step)
+{
+    return (step->length_minutes > 0 && !step->length_months)
+        || (step->length_months > 0 && !step->length_minutes);
+}
+
+DLLEXPORT long_time_t timestep_up(const struct timestep *step, long_time_t t)
+{
+    return timestep_boundary(step, timestep_index(step, t));
+}
+
+DLLEXPORT long_time_t timestep_next(const struct timestep *step,
+                                                                long_time_t t)
+{
+    return timestep_boundary(step, timestep_index(step, t + 1));
+}
+
+DLLEXPORT long_time_t timestep_prev(const struct timestep *step,
+                                                                long_time_t t)
+{
+    return timestep_boundary(step, timestep_index(step, t) - 1);
+}
+
 DLLEXPORT struct interval_list *il_create(void)
 {
     struct interval_list *intrvls;
@@ -669,6 +736,7 @@ DLLEXPORT struct interval_list *il_create(void)
                                                             interval_list))))
         return NULL;
     intrvls->n = 0;
+    intrvls->size = 0;
     intrvls->intervals = NULL;
     return intrvls;
 }
@@ -681,13 +749,18 @@ DLLEXPORT void il_free(struct interval_list *intrvls)
     free(intrvls);
 }
 
+/* The array grows by doubling, so that appending is amortized O(1). */
 DLLEXPORT int il_append(struct interval_list *intrvls, long_time_t start_date,
                                                         long_time_t end_date)
 {
-    struct interval *p = realloc(intrvls->intervals,
-									(intrvls->n + 1)*sizeof(struct interval));
-    if(p==NULL) return errno;
-    intrvls->intervals = p;
+    if(intrvls->n >= intrvls->size) {
+        int size = intrvls->size ? 2*intrvls->size : 16;
+        struct interval *p = realloc(intrvls->intervals,
+                                            size*sizeof(struct interval));
+        if(p==NULL) return errno;
+        intrvls->intervals = p;
+        intrvls->size = size;
+    }
     intrvls->intervals[intrvls->n].start_date = start_date;
     intrvls->intervals[(intrvls->n)++].end_date = end_date;
     return 0;
@@ -699,7 +772,141 @@ DLLEXPORT int il_delete(struct interval_list *intrvls, int index)
         return EINVAL;
     memmove(intrvls->intervals + index, intrvls->intervals + (index + 1),
                             (intrvls->n - index - 1)*sizeof(struct interval));
-    intrvls -> intervals = realloc(intrvls->intervals, 
-                                (--(intrvls->n))*sizeof(struct interval));
+    --(intrvls->n);
     return 0;
 }
+
+static int compare_intervals(const void *a, const void *b)
+{
+    const struct interval *ia = a;
+    const struct interval *ib = b;
+    if(ia->start_date != ib->start_date)
+        return ia->start_date < ib->start_date ? -1 : 1;
+    if(ia->end_date != ib->end_date)
+        return ia->end_date < ib->end_date ? -1 : 1;
+    return 0;
+}
+
+/* Sorts the intervals and merges those that overlap or touch (the next one
+ * starts on or before the second after the end of the previous one), so that
+ * the result is sorted, disjoint, non-adjacent, and covers the same dates.
+ */
+DLLEXPORT void il_normalize(struct interval_list *intrvls)
+{
+    struct interval *p = intrvls->intervals;
+    int i, n = 0;
+
+    if(intrvls->n == 0)
+        return;
+    qsort(p, intrvls->n, sizeof(struct interval), compare_intervals);
+    for(i = 1; i < intrvls->n; ++i) {
+        if(p[n].end_date == LONG_TIME_T_MAX
+                                || p[i].start_date <= p[n].end_date + 1) {
+            if(p[i].end_date > p[n].end_date)
+                p[n].end_date = p[i].end_date;
+        } else
+            p[++n] = p[i];
+    }
+    intrvls->n = n + 1;
+}
+
+/* il_index */
+
+static int compare_il_index_items(const void *a, const void *b)
+{
+    const struct il_index_item *ia = a;
+    const struct il_index_item *ib = b;
+    if(ia->start_date != ib->start_date)
+        return ia->start_date < ib->start_date ? -1 : 1;
+    return ia->index - ib->index;
+}
+
+/* Sets the max_end of the subtree of items lo..hi-1 and returns it. */
+static long_time_t set_max_end(struct il_index_item *items, int lo, int hi)
+{
+    int mid = lo + (hi - lo)/2;
+    long_time_t m = items[mid].end_date;
+
+    if(lo < mid) {
+        long_time_t left = set_max_end(items, lo, mid);
+        if(left > m) m = left;
+    }
+    if(mid + 1 < hi) {
+        long_time_t right = set_max_end(items, mid + 1, hi);
+        if(right > m) m = right;
+    }
+    return items[mid].max_end = m;
+}
+
+DLLEXPORT struct il_index *il_index_create(
+                                        const struct interval_list *intrvls)
+{
+    struct il_index *idx;
+    int i;
+
+    if(!(idx = malloc(sizeof(struct il_index))))
+        return NULL;
+    idx->n = intrvls->n;
+    idx->items = NULL;
+    if(idx->n == 0)
+        return idx;
+    if(!(idx->items = malloc(idx->n*sizeof(struct il_index_item)))) {
+        free(idx);
+        return NULL;
+    }
+    for(i = 0; i < idx->n; ++i) {
+        idx->items[i].start_date = intrvls->intervals[i].start_date;
+        idx->items[i].end_date = intrvls->intervals[i].end_date;
+        idx->items[i].index = i;
+    }
+    qsort(idx->items, idx->n, sizeof(struct il_index_item),
+                                                    compare_il_index_items);
+    set_max_end(idx->items, 0, idx->n);
+    return idx;
+}
+
+DLLEXPORT void il_index_free(struct il_index *idx)
+{
+    if(!idx) return;
+    free(idx->items);
+    free(idx);
+}
+
+/* Visits the subtree of items lo..hi-1 in order, skipping the subtrees whose
+ * max_end is before start_date and stopping at the first item that starts
+ * after end_date. Returns the updated count.
+ */
+static int il_index_query(const struct il_index_item *items, int lo, int hi,
+    long_time_t start_date, long_time_t end_date, int *result, int max,
+    int count)
+{
+    while(lo < hi) {
+        int mid = lo + (hi - lo)/2;
+        if(items[mid].max_end < start_date)
+            break;
+        count = il_index_query(items, lo, mid, start_date, end_date, result,
+                                                                max, count);
+        if(items[mid].start_date > end_date)
+            break;
+        if(items[mid].end_date >= start_date) {
+            if(count < max)
+                result[count] = items[mid].index;
+            ++count;
+        }
+        lo = mid + 1;
+    }
+    return count;
+}
+
+DLLEXPORT int il_index_overlaps(const struct il_index *idx,
+            long_time_t start_date, long_time_t end_date, int *result, int max)
+{
+    return il_index_query(idx->items, 0, idx->n, start_date, end_date, result,
+                                                                    max, 0);
+}
+
+DLLEXPORT int il_index_stab(const struct il_index *idx, long_time_t t,
+                                                        int *result, int max)
+{
+    return il_index_overlaps(idx, t, t, result, max);
+}
@@ -34,6 +34,39 @@ struct interval {
 struct interval_list {
     struct interval *intervals;
     int n;
+    int size;   /* Number of allocated intervals */
+};
+
+/* An index of the intervals of an interval list, for finding those that
+ * contain a date or overlap a range. The items are sorted by start date and
+ * form an implicit balanced tree: the root of items lo..hi-1 is their
+ * middle item, mid, and its max_end is the greatest end date of lo..hi-1.
+ * The index is a snapshot; it does not follow later changes to the list.
+ */
+struct il_index_item {
+    long_time_t start_date;
+    long_time_t end_date;
+    long_time_t max_end;
+    int index;  /* In the interval list */
+};
+
+struct il_index {
+    struct il_index_item *items;
+    int n;
+};
+
+/* A time step is either a number of minutes or a number of months (the other
+ * must be zero). Boundaries are at offset_minutes past the epoch plus a
+ * multiple of length_minutes or, for months, at offset_minutes past the
+ * beginning of each month whose number since year 0 is offset_months plus a
+ * multiple of length_months (e.g. 12 and 9 for hydrological years starting
+ * in October).
+ */
+struct timestep {
+    int length_minutes;
+    int length_months;
+    int offset_minutes;
+    int offset_months;
 };
 
 /* Caution: year argument in month_days is
@@ -46,11 +79,30 @@ extern int parsedatestring(const char *s, struct tm *tm, char **errmsg);
 extern void igmtime(long_time_t gm_time, struct tm *tm);
 extern long_time_t ydhms_diffl (int year1, int yday1, int hour1, int min1,
     int sec1, int year0, int yday0, int hour0, int min0, int sec0);
+extern DLLEXPORT int timestep_is_valid(const struct timestep *step);
+extern DLLEXPORT long_time_t timestep_up(const struct timestep *step,
+                                                            long_time_t t);
+extern DLLEXPORT long_time_t timestep_next(const struct timestep *step,
+                                                            long_time_t t);
+extern DLLEXPORT long_time_t timestep_prev(const struct timestep *step,
+                                                            long_time_t t);
+extern DLLEXPORT long long timestep_index(const struct timestep *step,
+                                                            long_time_t t);
+extern DLLEXPORT long_time_t timestep_boundary(const struct timestep *step,
+                                                            long long k);
 extern DLLEXPORT struct interval_list *il_create(void);
 extern DLLEXPORT void il_free(struct interval_list *intrvls);
 extern DLLEXPORT int il_append(struct interval_list *intrvls,
                                 long_time_t start_date, long_time_t end_date);
 extern DLLEXPORT int il_delete(struct interval_list *intrvls, int index);
+extern DLLEXPORT void il_normalize(struct interval_list *intrvls);
+extern DLLEXPORT struct il_index *il_index_create(
+                                        const struct interval_list *intrvls);
+extern DLLEXPORT void il_index_free(struct il_index *idx);
+extern DLLEXPORT int il_index_stab(const struct il_index *idx, long_time_t t,
+                                                        int *result, int max);
+extern DLLEXPORT int il_index_overlaps(const struct il_index *idx,
+            long_time_t start_date, long_time_t end_date, int *result, int max);
 extern DLLEXPORT const long_time_t LONG_TIME_T_MIN;
 extern DLLEXPORT const long_time_t LONG_TIME_T_MAX;
 
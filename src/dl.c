@@ -18,8 +18,11 @@
 
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
 #include "dates.h"
 #include "dl.h"
+#include "heap.h"
+#include "search.h"
 #include "platform.h"
 
 /* Makes sure that the data block allocated for the timeseries data is large
@@ -42,6 +45,25 @@ static int check_block_size(struct datetimelist *dl, int nrecords)
     return 0;
 }
 
+/* Notifies the search index, if any, that records index and following have
+ * been modified, inserted or deleted; see search_changed.
+ */
+static void records_changed(struct datetimelist *dl, int index)
+{
+    if(dl->search_index)
+        search_changed(dl->search_index, index, dl->nrecords);
+}
+
+/* Rebuilds the search index, if any, after all records have been replaced;
+ * this costs no more than replacing them.
+ */
+static void records_replaced(struct datetimelist *dl)
+{
+    if(dl->search_index)
+        search_build(dl->search_index, dl->data, sizeof(long_time_t),
+                                                                dl->nrecords);
+}
+
 DLLEXPORT int dl_append_record(struct datetimelist *dl, long_time_t timestamp,
     int *recindex, char **errstr)
 {
@@ -57,6 +79,9 @@ DLLEXPORT int dl_append_record(struct datetimelist *dl, long_time_t timestamp,
     r = dl->data + dl->nrecords++;
     *recindex = dl->nrecords-1;
     *r = timestamp;
+    if(dl->search_index)
+        search_appended(dl->search_index, dl->data, sizeof(long_time_t),
+                                                                dl->nrecords);
     return 0;
 
 GENFAIL:
@@ -89,6 +114,7 @@ DLLEXPORT int dl_insert_record(struct datetimelist *dl, long_time_t timestamp,
     r = dl->data + next_item;
     *recindex = next_item;
     *r = timestamp;
+    records_changed(dl, next_item);
     return 0;
 
 GENFAIL:
@@ -100,9 +126,15 @@ DLLEXPORT long_time_t *dl_get_next(const struct datetimelist *dl,
                                                         long_time_t timestamp)
 {
     long_time_t *low, *high, *mid;
+    int i;
 
     if(!dl->nrecords)
         return NULL;
+    if(dl->search_index) {
+        i = search_lower_bound(dl->search_index, dl->data,
+                                sizeof(long_time_t), dl->nrecords, timestamp);
+        return i < dl->nrecords ? dl->data + i : NULL;
+    }
     low = dl->data;
     high = dl->data + (dl->nrecords - 1);
     while(low<=high) {
@@ -179,6 +211,7 @@ DLLEXPORT long_time_t *dl_delete_records(struct datetimelist *dl,
         return NULL;
     memmove(r1, r2+1, (end-r2)*sizeof(long_time_t));
     dl->nrecords-= r2-r1+1;
+    records_changed(dl, r1-start);
     return r1;
 }
 
@@ -191,6 +224,20 @@ DLLEXPORT int dl_delete_record(struct datetimelist *dl, long_time_t tm)
     return dl_delete_item(dl, i);
 }
 
+DLLEXPORT int dl_reserve(struct datetimelist *dl, int nrecords)
+{
+    void *p;
+    size_t s = nrecords * sizeof(long_time_t);
+
+    if(dl->memblocksize >= s)
+        return 0;
+    if(!(p = realloc(dl->data, s)))
+        return errno;
+    dl->data = p;
+    dl->memblocksize = s;
+    return 0;
+}
+
 DLLEXPORT struct datetimelist *dl_create(void)
 {
     struct datetimelist *dl;
@@ -200,12 +247,14 @@ DLLEXPORT struct datetimelist *dl_create(void)
     dl->nrecords = 0;
     dl->data = NULL;
     dl->memblocksize = 0;
+    dl->search_index = NULL;
     return dl;
 }
 
 DLLEXPORT void dl_free(struct datetimelist *dl)
 {
     dl_clear(dl);
+    search_free(dl->search_index);
     free(dl->data);
     dl->data=NULL;
     free(dl);
@@ -219,6 +268,38 @@ DLLEXPORT int dl_length(const struct datetimelist *dl)
 DLLEXPORT void dl_clear(struct datetimelist *dl)
 {
     dl->nrecords = 0;
+    records_replaced(dl);
+}
+
+DLLEXPORT int dl_attach_search_index(struct datetimelist *dl, int mode)
+{
+    int r;
+
+    if(mode != SEARCH_EYTZINGER && mode != SEARCH_INTERPOLATION)
+        return EINVAL;
+    dl_detach_search_index(dl);
+    if(!(dl->search_index = search_create(mode)))
+        return errno;
+    if((r = search_build(dl->search_index, dl->data, sizeof(long_time_t),
+                                                            dl->nrecords))) {
+        dl_detach_search_index(dl);
+        return r;
+    }
+    return 0;
+}
+
+DLLEXPORT void dl_detach_search_index(struct datetimelist *dl)
+{
+    search_free(dl->search_index);
+    dl->search_index = NULL;
+}
+
+DLLEXPORT int dl_update_search_index(struct datetimelist *dl)
+{
+    if(!dl->search_index)
+        return 0;
+    return search_update(dl->search_index, dl->data, sizeof(long_time_t),
+                                                                dl->nrecords);
 }
 
 DLLEXPORT long_time_t dl_get_item(struct datetimelist *dl, int index)
@@ -226,3 +307,251 @@ DLLEXPORT long_time_t dl_get_item(struct datetimelist *dl, int index)
     return dl->data[index];
 }
 
+/* Cursors */
+
+DLLEXPORT void dl_cursor_init(struct dl_cursor *c,
+                                            const struct datetimelist *dl)
+{
+    c->dl = dl;
+    c->index = 0;
+}
+
+DLLEXPORT long_time_t *dl_cursor_get(const struct dl_cursor *c)
+{
+    if(c->index < 0 || c->index >= c->dl->nrecords)
+        return NULL;
+    return c->dl->data + c->index;
+}
+
+DLLEXPORT long_time_t *dl_cursor_next(struct dl_cursor *c)
+{
+    if(c->index < c->dl->nrecords)
+        ++(c->index);
+    return dl_cursor_get(c);
+}
+
+DLLEXPORT long_time_t *dl_cursor_prev(struct dl_cursor *c)
+{
+    if(c->index >= 0)
+        --(c->index);
+    return dl_cursor_get(c);
+}
+
+DLLEXPORT long_time_t *dl_cursor_seek_next(struct dl_cursor *c,
+                                                        long_time_t timestamp)
+{
+    c->index = search_gallop(c->dl->data, sizeof(long_time_t),
+                                    c->dl->nrecords, c->index, timestamp);
+    return dl_cursor_get(c);
+}
+
+DLLEXPORT long_time_t *dl_cursor_seek_prev(struct dl_cursor *c,
+                                                        long_time_t timestamp)
+{
+    long_time_t *r = dl_cursor_seek_next(c, timestamp);
+    if(!r || *r != timestamp)
+        --(c->index);
+    return dl_cursor_get(c);
+}
+
+DLLEXPORT long_time_t *dl_cursor_seek(struct dl_cursor *c,
+                                                        long_time_t timestamp)
+{
+    long_time_t *r = dl_cursor_seek_next(c, timestamp);
+    return (r && *r==timestamp) ? r : NULL;
+}
+
+/* Set operations. The result is made in a new block, presized for the
+ * largest possible result, which then replaces the block of dest; so dest
+ * may be one of the operands.
+ */
+
+#define DL_UNION 0
+#define DL_INTERSECT 1
+#define DL_DIFFERENCE 2
+
+static void replace_data(struct datetimelist *dest, long_time_t *data, int n,
+                                                                    int size)
+{
+    free(dest->data);
+    dest->data = data;
+    dest->nrecords = n;
+    dest->memblocksize = size * sizeof(long_time_t);
+    records_replaced(dest);
+}
+
+static int set_operation(struct datetimelist *dest,
+            const struct datetimelist *a, const struct datetimelist *b,
+            int operation, char **errstr)
+{
+    long_time_t *data = NULL;
+    int i = 0, j = 0, n = 0;
+    int size = operation == DL_UNION ? a->nrecords + b->nrecords
+            : (operation == DL_INTERSECT && b->nrecords < a->nrecords)
+            ? b->nrecords : a->nrecords;
+
+    if(size && !(data = malloc(size * sizeof(long_time_t)))) {
+        *errstr = strerror(errno);
+        return errno;
+    }
+    while(i < a->nrecords && j < b->nrecords) {
+        if(a->data[i] < b->data[j]) {
+            if(operation != DL_INTERSECT)
+                data[n++] = a->data[i];
+            ++i;
+        } else if(a->data[i] > b->data[j]) {
+            if(operation == DL_UNION)
+                data[n++] = b->data[j];
+            ++j;
+        } else {
+            if(operation != DL_DIFFERENCE)
+                data[n++] = a->data[i];
+            ++i;
+            ++j;
+        }
+    }
+    if(operation != DL_INTERSECT)
+        while(i < a->nrecords)
+            data[n++] = a->data[i++];
+    if(operation == DL_UNION)
+        while(j < b->nrecords)
+            data[n++] = b->data[j++];
+    replace_data(dest, data, n, size);
+    return 0;
+}
+
+DLLEXPORT int dl_union(struct datetimelist *dest, const struct datetimelist *a,
+                            const struct datetimelist *b, char **errstr)
+{
+    return set_operation(dest, a, b, DL_UNION, errstr);
+}
+
+DLLEXPORT int dl_intersect(struct datetimelist *dest,
+            const struct datetimelist *a, const struct datetimelist *b,
+            char **errstr)
+{
+    return set_operation(dest, a, b, DL_INTERSECT, errstr);
+}
+
+DLLEXPORT int dl_difference(struct datetimelist *dest,
+            const struct datetimelist *a, const struct datetimelist *b,
+            char **errstr)
+{
+    return set_operation(dest, a, b, DL_DIFFERENCE, errstr);
+}
+
+/* The lists are merged by a k-way merge. */
+DLLEXPORT int dl_merge_many(struct datetimelist *dest,
+            struct datetimelist *const *lists, int nlists, char **errstr)
+{
+    struct kmerge km;
+    long_time_t *data = NULL;
+    long_time_t t;
+    int i, n = 0, size = 0;
+    int result;
+
+    if((result = kmerge_init(&km, nlists, sizeof(long_time_t))))
+        goto ERROR;
+    for(i = 0; i < nlists; ++i) {
+        size += lists[i]->nrecords;
+        if(lists[i]->nrecords)
+            kmerge_add(&km, i, lists[i]->data, 0, lists[i]->nrecords);
+    }
+    if(size && !(data = malloc(size * sizeof(long_time_t)))) {
+        result = errno;
+        kmerge_free(&km);
+        goto ERROR;
+    }
+    while(kmerge_next(&km, &t))
+        data[n++] = t;
+    kmerge_free(&km);
+    replace_data(dest, data, n, size);
+    return 0;
+
+ERROR:
+    *errstr = strerror(result);
+    return result;
+}
+
+/* Recurrences */
+
+DLLEXPORT int dlr_init(struct dl_recurrence *rec, const struct timestep *step,
+        long_time_t start_date, long_time_t end_date, char **errstr)
+{
+    if(!timestep_is_valid(step)) {
+        *errstr = "Invalid time step";
+        return EINVAL;
+    }
+    rec->step = *step;
+    rec->first = timestep_index(step, start_date);
+    rec->last = timestep_index(step, end_date);
+    if(timestep_boundary(step, rec->last) > end_date)
+        --(rec->last);
+    if(rec->last < rec->first)
+        rec->last = rec->first - 1;
+    if(rec->last - rec->first >= INT_MAX) {
+        *errstr = "Recurrence too long";
+        return EOVERFLOW;
+    }
+    return 0;
+}
+
+DLLEXPORT int dlr_length(const struct dl_recurrence *rec)
+{
+    return (int) (rec->last - rec->first + 1);
+}
+
+DLLEXPORT long_time_t dlr_get_item(const struct dl_recurrence *rec,
+                                                                int index)
+{
+    return timestep_boundary(&rec->step, rec->first + index);
+}
+
+DLLEXPORT int dlr_get_next_i(const struct dl_recurrence *rec,
+                                                        long_time_t timestamp)
+{
+    long long k = timestep_index(&rec->step, timestamp);
+    if(k < rec->first)
+        k = rec->first;
+    return k > rec->last ? -1 : (int) (k - rec->first);
+}
+
+DLLEXPORT int dlr_get_prev_i(const struct dl_recurrence *rec,
+                                                        long_time_t timestamp)
+{
+    long long k = timestep_index(&rec->step, timestamp);
+    if(timestep_boundary(&rec->step, k) > timestamp)
+        --k;
+    if(k > rec->last)
+        k = rec->last;
+    return k < rec->first ? -1 : (int) (k - rec->first);
+}
+
+DLLEXPORT int dlr_get_i(const struct dl_recurrence *rec,
+                                                        long_time_t timestamp)
+{
+    long long k = timestep_index(&rec->step, timestamp);
+    if(k < rec->first || k > rec->last
+                        || timestep_boundary(&rec->step, k) != timestamp)
+        return -1;
+    return (int) (k - rec->first);
+}
+
+/* Replaces the contents of dl with the items of rec; on error dl is
+ * unchanged.
+ */
+DLLEXPORT int dlr_materialize(const struct dl_recurrence *rec,
+                                    struct datetimelist *dl, char **errstr)
+{
+    int i, n = dlr_length(rec);
+
+    if(dl_reserve(dl, n)) {
+        *errstr = strerror(errno);
+        return errno;
+    }
+    for(i = 0; i < n; ++i)
+        dl->data[i] = timestep_boundary(&rec->step, rec->first + i);
+    dl->nrecords = n;
+    records_replaced(dl);
+    return 0;
+}
@@ -27,10 +27,13 @@
 #include "platform.h"
 #include "dates.h"
 
+struct search_index;
+
 struct datetimelist {
     long_time_t *data;
     int nrecords;
     size_t memblocksize;
+    struct search_index *search_index; /* Optional, see search.h */
 };
 
 extern DLLEXPORT int dl_append_record(struct datetimelist *dl, long_time_t timestamp,
@@ -50,10 +53,72 @@ extern DLLEXPORT int dl_delete_item(struct datetimelist *dl, int index);
 extern DLLEXPORT long_time_t *dl_delete_records(struct datetimelist *dl,
                                     long_time_t *r1, long_time_t *r2);
 extern DLLEXPORT int dl_delete_record(struct datetimelist *dl, long_time_t tm);
+extern DLLEXPORT int dl_reserve(struct datetimelist *dl, int nrecords);
 extern DLLEXPORT struct datetimelist *dl_create(void);
 extern DLLEXPORT void dl_free(struct datetimelist *dl);
 extern DLLEXPORT int dl_length(const struct datetimelist *dl);
 extern DLLEXPORT void dl_clear(struct datetimelist *dl);
 extern DLLEXPORT long_time_t dl_get_item(struct datetimelist *dl, int index);
+extern DLLEXPORT int dl_attach_search_index(struct datetimelist *dl,
+                                                                    int mode);
+extern DLLEXPORT void dl_detach_search_index(struct datetimelist *dl);
+extern DLLEXPORT int dl_update_search_index(struct datetimelist *dl);
+extern DLLEXPORT int dl_union(struct datetimelist *dest,
+    const struct datetimelist *a, const struct datetimelist *b,
+    char **errstr);
+extern DLLEXPORT int dl_intersect(struct datetimelist *dest,
+    const struct datetimelist *a, const struct datetimelist *b,
+    char **errstr);
+extern DLLEXPORT int dl_difference(struct datetimelist *dest,
+    const struct datetimelist *a, const struct datetimelist *b,
+    char **errstr);
+extern DLLEXPORT int dl_merge_many(struct datetimelist *dest,
+    struct datetimelist *const *lists, int nlists, char **errstr);
+
+/* A position in a datetimelist, from -1 (before the first record) to
+ * nrecords (after the last); see ts_cursor.
+ */
+struct dl_cursor {
+    const struct datetimelist *dl;
+    int index;
+};
+
+extern DLLEXPORT void dl_cursor_init(struct dl_cursor *c,
+                                            const struct datetimelist *dl);
+extern DLLEXPORT long_time_t *dl_cursor_get(const struct dl_cursor *c);
+extern DLLEXPORT long_time_t *dl_cursor_next(struct dl_cursor *c);
+extern DLLEXPORT long_time_t *dl_cursor_prev(struct dl_cursor *c);
+extern DLLEXPORT long_time_t *dl_cursor_seek(struct dl_cursor *c,
+                                                        long_time_t timestamp);
+extern DLLEXPORT long_time_t *dl_cursor_seek_next(struct dl_cursor *c,
+                                                        long_time_t timestamp);
+extern DLLEXPORT long_time_t *dl_cursor_seek_prev(struct dl_cursor *c,
+                                                        long_time_t timestamp);
+
+/* A recurrence is a datetimelist that is computed instead of stored: the
+ * boundaries of step from start_date to end_date. Its items are numbered
+ * like those of a datetimelist, and the dlr_ functions correspond to the
+ * dl_ functions, returning indexes (or -1) instead of pointers; they all take
+ * constant time.
+ */
+struct dl_recurrence {
+    struct timestep step;
+    long long first, last;  /* Numbers of first and last boundary */
+};
+
+extern DLLEXPORT int dlr_init(struct dl_recurrence *rec,
+    const struct timestep *step, long_time_t start_date, long_time_t end_date,
+    char **errstr);
+extern DLLEXPORT int dlr_length(const struct dl_recurrence *rec);
+extern DLLEXPORT long_time_t dlr_get_item(const struct dl_recurrence *rec,
+                                                                int index);
+extern DLLEXPORT int dlr_get_next_i(const struct dl_recurrence *rec,
+                                                        long_time_t timestamp);
+extern DLLEXPORT int dlr_get_prev_i(const struct dl_recurrence *rec,
+                                                        long_time_t timestamp);
+extern DLLEXPORT int dlr_get_i(const struct dl_recurrence *rec,
+                                                        long_time_t timestamp);
+extern DLLEXPORT int dlr_materialize(const struct dl_recurrence *rec,
+                                    struct datetimelist *dl, char **errstr);
 
 #endif /* _DL_H */
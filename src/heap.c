@@ -0,0 +1,131 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * heap.c - binary heap of timestamps, for k-way merging
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include "heap.h"
+
+#define KEY(base, stride, i) \
+    (*(const long_time_t *) ((const char *) (base) + (size_t) (i) * (stride)))
+
+static int less(const struct heap_item *a, const struct heap_item *b)
+{
+    return a->timestamp < b->timestamp
+        || (a->timestamp == b->timestamp && a->source < b->source);
+}
+
+void heap_push(struct heap *h, long_time_t timestamp, int source)
+{
+    struct heap_item item;
+    int i = (h->n)++;
+
+    item.timestamp = timestamp;
+    item.source = source;
+    while(i > 0 && less(&item, h->items + (i-1)/2)) {
+        h->items[i] = h->items[(i-1)/2];
+        i = (i-1)/2;
+    }
+    h->items[i] = item;
+}
+
+struct heap_item heap_pop(struct heap *h)
+{
+    struct heap_item top = h->items[0];
+    struct heap_item last = h->items[--(h->n)];
+    int i = 0, child;
+
+    while((child = 2*i + 1) < h->n) {
+        if(child + 1 < h->n && less(h->items + child + 1, h->items + child))
+            ++child;
+        if(!less(h->items + child, &last))
+            break;
+        h->items[i] = h->items[child];
+        i = child;
+    }
+    if(h->n)
+        h->items[i] = last;
+    return top;
+}
+
+/* Returns zero or errno. The sources are initially empty. */
+int kmerge_init(struct kmerge *km, int nsources, size_t stride)
+{
+    km->heap.n = 0;
+    km->stride = stride;
+    km->nsources = 0;
+    km->heap.items = NULL;
+    km->base = NULL;
+    km->cursor = km->end = km->sources = NULL;
+    if(!nsources)
+        return 0;
+    if(!(km->heap.items = malloc(nsources * sizeof(struct heap_item)))
+            || !(km->base = calloc(nsources, sizeof(const void *)))
+            || !(km->cursor = calloc(nsources, sizeof(int)))
+            || !(km->end = calloc(nsources, sizeof(int)))
+            || !(km->sources = malloc(nsources * sizeof(int)))) {
+        int result = errno;
+        kmerge_free(km);
+        return result;
+    }
+    return 0;
+}
+
+/* Must be called before the first kmerge_next. */
+void kmerge_add(struct kmerge *km, int source, const void *base, int first,
+                                                                    int end)
+{
+    km->base[source] = base;
+    km->cursor[source] = first;
+    km->end[source] = end;
+    if(first < end)
+        heap_push(&km->heap, KEY(base, km->stride, first), source);
+}
+
+/* Returns the number of sources with the next timestamp, or zero if all
+ * sources have been exhausted.
+ */
+int kmerge_next(struct kmerge *km, long_time_t *timestamp)
+{
+    int i, s;
+
+    for(i = 0; i < km->nsources; ++i) {
+        s = km->sources[i];
+        if(++(km->cursor[s]) < km->end[s])
+            heap_push(&km->heap, KEY(km->base[s], km->stride, km->cursor[s]),
+                                                                        s);
+    }
+    km->nsources = 0;
+    if(!km->heap.n)
+        return 0;
+    *timestamp = km->heap.items[0].timestamp;
+    while(km->heap.n && km->heap.items[0].timestamp == *timestamp)
+        km->sources[(km->nsources)++] = heap_pop(&km->heap).source;
+    return km->nsources;
+}
+
+void kmerge_free(struct kmerge *km)
+{
+    free(km->heap.items);
+    free(km->base);
+    free(km->cursor);
+    free(km->end);
+    free(km->sources);
+    km->heap.items = NULL;
+    km->base = NULL;
+    km->cursor = km->end = km->sources = NULL;
+}
@@ -0,0 +1,68 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * heap.h - binary heap of timestamps, for k-way merging
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _HEAP_H
+
+#define _HEAP_H
+
+#include <stddef.h>
+#include "dates.h"
+
+/* Used internally. A min-heap of (timestamp, source) pairs, where source
+ * is the index of the list the timestamp comes from; equal timestamps are
+ * ordered by source. The caller allocates items with room for as many
+ * items as there are sources.
+ */
+
+struct heap_item {
+    long_time_t timestamp;
+    int source;
+};
+
+struct heap {
+    struct heap_item *items;
+    int n;
+};
+
+extern void heap_push(struct heap *h, long_time_t timestamp, int source);
+extern struct heap_item heap_pop(struct heap *h);
+
+/* A k-way merge of sorted sources of timestamps, yielding each distinct
+ * timestamp once with the sources that have it. Source i is the items
+ * cursor[i]..end[i]-1 of an array whose items are stride bytes apart, with
+ * the timestamp of item 0 at base[i]. After kmerge_next returns n, the
+ * sources with the timestamp are sources[0..n-1] (in increasing order) and
+ * cursor[s] is the index of the item of source s with that timestamp.
+ */
+struct kmerge {
+    struct heap heap;
+    size_t stride;
+    const void **base;
+    int *cursor;
+    int *end;
+    int *sources;
+    int nsources;   /* Of the last timestamp */
+};
+
+extern int kmerge_init(struct kmerge *km, int nsources, size_t stride);
+extern void kmerge_add(struct kmerge *km, int source, const void *base,
+                                                        int first, int end);
+extern int kmerge_next(struct kmerge *km, long_time_t *timestamp);
+extern void kmerge_free(struct kmerge *km);
+
+#endif /* _HEAP_H */
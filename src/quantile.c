@@ -0,0 +1,211 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * quantile.c - quantile estimation
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <math.h>
+#include "ts.h"
+#include "tsindex.h"
+#include "quantile.h"
+#include "platform.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+DLLEXPORT struct tdigest *td_create(double compression)
+{
+    struct tdigest *td;
+
+    if(compression < 10.0)
+        compression = 10.0;
+    if(!(td = (struct tdigest *) malloc(sizeof(struct tdigest))))
+        return NULL;
+    td->compression = compression;
+    /* The compressed centroids are fewer than compression; an equal
+     * amount of room is left for added ones.
+     */
+    td->capacity = 2 * ((int) compression + 10);
+    if(!(td->centroids = malloc(td->capacity * sizeof(struct td_centroid)))) {
+        free(td);
+        return NULL;
+    }
+    td_clear(td);
+    return td;
+}
+
+DLLEXPORT void td_free(struct tdigest *td)
+{
+    if(!td) return;
+    free(td->centroids);
+    td->centroids = NULL;
+    free(td);
+}
+
+DLLEXPORT void td_clear(struct tdigest *td)
+{
+    td->nmerged = td->ncentroids = 0;
+    td->total_weight = 0.0;
+    td->min = td->max = NAN;
+}
+
+static int compare_centroids(const void *a, const void *b)
+{
+    double ma = ((const struct td_centroid *) a)->mean;
+    double mb = ((const struct td_centroid *) b)->mean;
+    return ma < mb ? -1 : (ma > mb ? 1 : 0);
+}
+
+/* Scale function k1: k(q) = compression/(2 pi) asin(2q - 1). A centroid may
+ * span at most one unit of k; q_limit returns the largest q it may reach if
+ * it starts at q0.
+ */
+static double q_limit(double compression, double q0)
+{
+    double k = compression / (2*M_PI) * asin(2*q0 - 1) + 1.0;
+    if(k >= compression / 4)
+        return 1.0;
+    return (sin(k * 2*M_PI / compression) + 1) / 2;
+}
+
+static void td_compress(struct tdigest *td)
+{
+    struct td_centroid *c = td->centroids;
+    struct td_centroid cur;
+    double weight_so_far = 0.0, limit;
+    int i, n = 0;
+
+    if(td->nmerged == td->ncentroids)
+        return;
+    qsort(c, td->ncentroids, sizeof(struct td_centroid), compare_centroids);
+    cur = c[0];
+    limit = td->total_weight * q_limit(td->compression, 0.0);
+    for(i = 1; i < td->ncentroids; ++i) {
+        if(weight_so_far + cur.weight + c[i].weight <= limit) {
+            cur.mean += (c[i].mean - cur.mean) * c[i].weight
+                                                / (cur.weight + c[i].weight);
+            cur.weight += c[i].weight;
+            continue;
+        }
+        weight_so_far += cur.weight;
+        c[n++] = cur;
+        limit = td->total_weight * q_limit(td->compression,
+                                        weight_so_far / td->total_weight);
+        cur = c[i];
+    }
+    c[n++] = cur;
+    td->nmerged = td->ncentroids = n;
+}
+
+DLLEXPORT void td_add(struct tdigest *td, double x, double weight)
+{
+    if(isnan(x) || weight <= 0.0)
+        return;
+    if(td->ncentroids == td->capacity)
+        td_compress(td);
+    td->centroids[td->ncentroids].mean = x;
+    td->centroids[(td->ncentroids)++].weight = weight;
+    td->total_weight += weight;
+    td->min = fmin(td->min, x);
+    td->max = fmax(td->max, x);
+}
+
+DLLEXPORT void td_merge(struct tdigest *td, const struct tdigest *other)
+{
+    struct td_centroid *c;
+
+    for(c = other->centroids; c < other->centroids + other->ncentroids; ++c)
+        td_add(td, c->mean, c->weight);
+    /* Centroids are not at the extremes, so min and max are kept apart. */
+    td->min = fmin(td->min, other->min);
+    td->max = fmax(td->max, other->max);
+}
+
+DLLEXPORT double td_quantile(struct tdigest *td, double q)
+{
+    struct td_centroid *c;
+    double index, weight_so_far, dw;
+    int i, n;
+
+    if(td->total_weight <= 0.0 || q < 0.0 || q > 1.0)
+        return NAN;
+    td_compress(td);
+    c = td->centroids;
+    n = td->ncentroids;
+    if(n == 1)
+        return c[0].mean;
+
+    /* Each centroid is assumed to have half its weight on either side of
+     * its mean; values are interpolated between adjacent means, and between
+     * the extreme means and min/max.
+     */
+    index = q * td->total_weight;
+    weight_so_far = c[0].weight / 2;
+    if(index <= weight_so_far)
+        return td->min + (c[0].mean - td->min) * index / weight_so_far;
+    for(i = 0; i < n - 1; ++i) {
+        dw = (c[i].weight + c[i+1].weight) / 2;
+        if(weight_so_far + dw > index)
+            return c[i].mean + (c[i+1].mean - c[i].mean)
+                                            * (index - weight_so_far) / dw;
+        weight_so_far += dw;
+    }
+    dw = c[n-1].weight / 2;
+    return c[n-1].mean + (td->max - c[n-1].mean)
+                                    * fmin(1.0, (index - weight_so_far) / dw);
+}
+
+DLLEXPORT void td_add_timeseries(struct tdigest *td,
+        const struct timeseries *ts, long_time_t start_date,
+        long_time_t end_date)
+{
+    struct ts_record *r = ts_get_next(ts, start_date);
+    struct ts_record *end = ts_get_prev(ts, end_date);
+    if(!r || !end)
+        return;
+    for(; r <= end; ++r)
+        if(!r->null)
+            td_add(td, r->value, 1.0);
+}
+
+DLLEXPORT double ts_quantile(const struct timeseries *ts, long_time_t start_date,
+                                            long_time_t end_date, double q)
+{
+    struct tdigest *td;
+    struct ts_record *r = ts_get_next(ts, start_date);
+    struct ts_record *end = ts_get_prev(ts, end_date);
+    double result = NAN;
+
+    if(!r || !end || r>end)
+        return NAN;
+    if(!(td = td_create(ts->quantile_index ? ts->quantile_index->compression
+                                           : TD_DEFAULT_COMPRESSION)))
+        return NAN;
+    if(ts->quantile_index) {
+        if(tsindex_range_digest(ts, r-ts->data, end-ts->data, td))
+            goto END;
+    } else
+        for(; r <= end; ++r)
+            if(!r->null)
+                td_add(td, r->value, 1.0);
+    result = td_quantile(td, q);
+
+END:
+    td_free(td);
+    return result;
+}
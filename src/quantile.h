@@ -0,0 +1,61 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * quantile.h - quantile estimation
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _QUANTILE_H
+
+#define _QUANTILE_H
+
+#include "platform.h"
+#include "dates.h"
+#include "ts.h"
+
+#define TD_DEFAULT_COMPRESSION 100.0
+
+struct td_centroid {
+    double mean;
+    double weight;
+};
+
+/* A t-digest (Dunning & Ertl), a mergeable summary of a distribution that
+ * estimates quantiles, more accurately towards the tails. centroids[0..
+ * nmerged-1] are compressed and sorted by mean; centroids[nmerged..
+ * ncentroids-1] have been added since the last compression.
+ */
+struct tdigest {
+    double compression;
+    struct td_centroid *centroids;
+    int nmerged;
+    int ncentroids;
+    int capacity;
+    double total_weight;
+    double min, max;
+};
+
+extern DLLEXPORT struct tdigest *td_create(double compression);
+extern DLLEXPORT void td_free(struct tdigest *td);
+extern DLLEXPORT void td_clear(struct tdigest *td);
+extern DLLEXPORT void td_add(struct tdigest *td, double x, double weight);
+extern DLLEXPORT void td_merge(struct tdigest *td, const struct tdigest *other);
+extern DLLEXPORT double td_quantile(struct tdigest *td, double q);
+extern DLLEXPORT void td_add_timeseries(struct tdigest *td,
+        const struct timeseries *ts, long_time_t start_date,
+        long_time_t end_date);
+extern DLLEXPORT double ts_quantile(const struct timeseries *ts,
+        long_time_t start_date, long_time_t end_date, double q);
+
+#endif /* _QUANTILE_H */
@@ -0,0 +1,227 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * search.c - accelerated search of sorted timestamps
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include "dates.h"
+#include "search.h"
+#include "platform.h"
+
+#ifdef __GNUC__
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p)
+#endif
+
+#define KEY(base, stride, i) \
+    (*(const long_time_t *) ((const char *) (base) + (size_t) (i) * (stride)))
+
+struct search_index *search_create(int mode)
+{
+    struct search_index *s;
+
+    if(!(s = malloc(sizeof(struct search_index))))
+        return NULL;
+    s->mode = mode;
+    s->n = 0;
+    s->stale = 0;
+    s->keys = NULL;
+    s->rank = NULL;
+    return s;
+}
+
+void search_free(struct search_index *s)
+{
+    if(!s)
+        return;
+    free(s->keys);
+    free(s->rank);
+    free(s);
+}
+
+/* Fills the subtree rooted at k with items i, i+1, ..., in order, and
+ * returns the next item.
+ */
+static int eytzinger_fill(struct search_index *s, const void *base,
+                                        size_t stride, int n, int i, int k)
+{
+    if(k > n)
+        return i;
+    i = eytzinger_fill(s, base, stride, n, i, 2 * k);
+    s->keys[k] = KEY(base, stride, i);
+    s->rank[k] = i;
+    return eytzinger_fill(s, base, stride, n, i + 1, 2 * k + 1);
+}
+
+int search_build(struct search_index *s, const void *base, size_t stride,
+                                                                        int n)
+{
+    void *p;
+
+    s->stale = 0;
+    if(s->mode != SEARCH_EYTZINGER) {
+        s->n = n;
+        return 0;
+    }
+    s->n = 0;
+    if(!n)
+        return 0;
+    if(!(p = realloc(s->keys, (n + 1) * sizeof(long_time_t))))
+        return errno;
+    s->keys = p;
+    if(!(p = realloc(s->rank, (n + 1) * sizeof(int))))
+        return errno;
+    s->rank = p;
+    eytzinger_fill(s, base, stride, n, 0, 1);
+    s->n = n;
+    return 0;
+}
+
+void search_appended(struct search_index *s, const void *base, size_t stride,
+                                                                        int n)
+{
+    if(s->mode != SEARCH_EYTZINGER)
+        s->n = n;
+    else if(!s->stale && n - s->n >= s->n)
+        search_build(s, base, stride, n);
+}
+
+void search_changed(struct search_index *s, int index, int n)
+{
+    if(s->mode != SEARCH_EYTZINGER)
+        s->n = n;
+    else if(index < s->n || n < s->n) {
+        s->n = 0;
+        s->stale = n > 0;
+    }
+}
+
+int search_update(struct search_index *s, const void *base, size_t stride,
+                                                                        int n)
+{
+    if(!s->stale)
+        return 0;
+    return search_build(s, base, stride, n);
+}
+
+static int binary_lower_bound(const void *base, size_t stride, int lo, int hi,
+                                                                long_time_t t)
+{
+    /* The result is in lo..hi */
+    while(lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if(KEY(base, stride, mid) < t)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int eytzinger_lower_bound(const struct search_index *s, long_time_t t)
+{
+    int k = 1;
+
+    while(k <= s->n) {
+        PREFETCH(s->keys + 16 * k);
+        PREFETCH(s->keys + 16 * k + 8);
+        k = 2 * k + (s->keys[k] < t);
+    }
+    /* Undo the right turns after the last left turn */
+    while(k & 1)
+        k >>= 1;
+    k >>= 1;
+    return k ? s->rank[k] : s->n;
+}
+
+/* Interpolation search, with a bisection step whenever interpolation does
+ * not at least halve the range, so that it is never worse than O(log n).
+ */
+static int interpolation_lower_bound(const void *base, size_t stride, int n,
+                                                                long_time_t t)
+{
+    int lo = 0, hi = n - 1;
+
+    if(!n || t <= KEY(base, stride, 0))
+        return 0;
+    if(t > KEY(base, stride, hi))
+        return n;
+    /* Invariant: key(lo) < t <= key(hi) */
+    while(hi - lo > 1) {
+        long_time_t klo = KEY(base, stride, lo);
+        long_time_t khi = KEY(base, stride, hi);
+        int width = hi - lo;
+        int guess = lo + (int) ((double) (t - klo) / (khi - klo) * width);
+        if(guess <= lo)
+            guess = lo + 1;
+        else if(guess >= hi)
+            guess = hi - 1;
+        if(KEY(base, stride, guess) < t)
+            lo = guess;
+        else
+            hi = guess;
+        if(hi - lo > width / 2 && hi - lo > 1) {
+            int mid = lo + (hi - lo) / 2;
+            if(KEY(base, stride, mid) < t)
+                lo = mid;
+            else
+                hi = mid;
+        }
+    }
+    return hi;
+}
+
+int search_lower_bound(const struct search_index *s, const void *base,
+                                        size_t stride, int n, long_time_t t)
+{
+    if(s->mode == SEARCH_INTERPOLATION)
+        return interpolation_lower_bound(base, stride, n, t);
+    if(s->n && t <= KEY(base, stride, s->n - 1))
+        return eytzinger_lower_bound(s, t);
+    return binary_lower_bound(base, stride, s->n, n, t);
+}
+
+int search_gallop(const void *base, size_t stride, int n, int pos,
+                                                            long_time_t t)
+{
+    int lo, hi, step = 1;
+
+    if(pos < 0)
+        pos = 0;
+    if(pos > n)
+        pos = n;
+    if(pos < n && KEY(base, stride, pos) < t) {
+        /* Forwards; items before lo are less than t */
+        lo = hi = pos + 1;
+        while(hi < n && KEY(base, stride, hi) < t) {
+            lo = hi + 1;
+            step *= 2;
+            hi = n - pos > step ? pos + step : n;
+        }
+        return binary_lower_bound(base, stride, lo, hi, t);
+    }
+    /* Backwards; item hi (if not n) is at least t */
+    hi = pos;
+    lo = pos - 1;
+    while(lo >= 0 && KEY(base, stride, lo) >= t) {
+        hi = lo;
+        step *= 2;
+        lo = pos - step;
+    }
+    return binary_lower_bound(base, stride, lo < 0 ? 0 : lo + 1, hi, t);
+}
@@ -0,0 +1,92 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * search.h - accelerated search of sorted timestamps
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _SEARCH_H
+
+#define _SEARCH_H
+
+#include <stddef.h>
+#include "platform.h"
+#include "dates.h"
+
+/* Search index modes. SEARCH_EYTZINGER keeps a copy of the timestamps in
+ * Eytzinger (breadth-first) order, keys[1..n], where the children of k are
+ * 2k and 2k+1, so that a search descends through adjacent memory and can be
+ * done without branches; rank[k] is the position of keys[k] in the data.
+ * SEARCH_INTERPOLATION stores nothing and guesses the position from the
+ * timestamp, which suits near-regular time series.
+ */
+#define SEARCH_EYTZINGER 0
+#define SEARCH_INTERPOLATION 1
+
+struct search_index {
+    int mode;
+    int n;          /* Items 0..n-1 of the data are in the index */
+    int stale;      /* Items have changed; nothing indexed until rebuilt */
+    long_time_t *keys;
+    int *rank;
+};
+
+/* Used internally by ts.c and dl.c. The timestamps searched are n items of
+ * size stride starting at base, which points to the timestamp of the first
+ * item.
+ */
+
+extern struct search_index *search_create(int mode);
+extern void search_free(struct search_index *s);
+
+/* Indexes items 0..n-1. On insufficient memory the index is emptied (so
+ * that searches fall back to binary search) and errno is returned.
+ */
+extern int search_build(struct search_index *s, const void *base,
+                                                    size_t stride, int n);
+
+/* Brings the index up to date after items have been appended, rebuilding it
+ * when the items not in it are as many as those in it. A stale index is left
+ * stale.
+ */
+extern void search_appended(struct search_index *s, const void *base,
+                                                    size_t stride, int n);
+
+/* Notes that items index and following have been modified, inserted or
+ * deleted, and that there are now n items. If any indexed item is affected,
+ * the index becomes stale (unless there are no items left): searches fall
+ * back to binary search until search_update is called. This takes constant time, so that a series of
+ * insertions does not rebuild the index each time.
+ */
+extern void search_changed(struct search_index *s, int index, int n);
+
+/* Rebuilds the index if it is stale; returns zero or errno as search_build.
+ */
+extern int search_update(struct search_index *s, const void *base,
+                                                    size_t stride, int n);
+
+/* Returns the index of the first of the n items which is at or after t, or
+ * n if none.
+ */
+extern int search_lower_bound(const struct search_index *s, const void *base,
+                                        size_t stride, int n, long_time_t t);
+
+/* Like search_lower_bound, but without using an index; searches from
+ * item pos outwards with exponentially growing steps (galloping), so that
+ * the time taken is logarithmic in the distance from pos to the result.
+ */
+extern int search_gallop(const void *base, size_t stride, int n, int pos,
+                                                            long_time_t t);
+
+#endif /* _SEARCH_H */
@@ -0,0 +1,357 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * snapshot.c - time series readable while being written
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snapshot.h"
+#include "ts.h"
+#include "tsindex.h"
+#include "platform.h"
+
+#ifdef __GNUC__
+#define ATOMIC_LOAD(p) __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(p, x) __atomic_store_n(p, x, __ATOMIC_SEQ_CST)
+#else
+/* Without atomics, only a single thread may use a versioned time series. */
+#define ATOMIC_LOAD(p) (*(p))
+#define ATOMIC_STORE(p, x) (*(p) = (x))
+#endif
+
+/* Sets *p to 1 if it is 0; returns nonzero on success. */
+static int claim(int *p)
+{
+#ifdef __GNUC__
+    int expected = 0;
+    return __atomic_compare_exchange_n(p, &expected, 1, 0, __ATOMIC_SEQ_CST,
+                                                            __ATOMIC_SEQ_CST);
+#else
+    return *p ? 0 : (*p = 1);
+#endif
+}
+
+/* The records are kept in blocks. Appending writes after the records that
+ * the published versions see, so it is done in place; when the block is
+ * full, the records are copied to a block twice as large, which takes over
+ * the flags strings, and the old block is freed without them once no
+ * reader uses it. A version is a struct timeseries that points into a
+ * block, and is freed the same way.
+ *
+ * Reclamation is epoch based. A reader announces the epoch when it starts
+ * reading; the writer stamps what it unlinks with the epoch at that time
+ * and then increments the epoch, and frees what was stamped before the
+ * earliest epoch announced by a reader still reading.
+ */
+#define TSV_IDLE (~0ULL)
+
+struct tsv_block {
+    struct ts_record *mem;  /* As allocated */
+    struct ts_record *data;
+    int size;               /* Capacity, starting at data */
+    int n;                  /* Records written */
+    int owns_flags;
+};
+
+struct tsv_garbage {
+    unsigned long long epoch;
+    struct tsv_block *block;
+    struct timeseries *version;
+    struct tsv_garbage *next;
+};
+
+/* Padded so that readers do not share cache lines. */
+struct tsv_reader {
+    unsigned long long epoch;
+    int in_use;
+    char pad[64 - sizeof(unsigned long long) - sizeof(int)];
+};
+
+struct ts_versioned {
+    struct timeseries *current;
+    unsigned long long epoch;
+    struct tsv_reader readers[TSV_MAXREADERS];
+    /* Writer state */
+    struct tsv_block *block;
+    struct tsv_garbage *pending;    /* To be unlinked by next publication */
+    struct tsv_garbage *retired;
+};
+
+static void free_block(struct tsv_block *b)
+{
+    int i;
+
+    if(!b) return;
+    if(b->owns_flags)
+        for(i = 0; i < b->n; ++i)
+            free(b->data[i].flags);
+    free(b->mem);
+    free(b);
+}
+
+static void free_garbage(struct tsv_garbage *g)
+{
+    free_block(g->block);
+    free(g->version);
+    free(g);
+}
+
+static struct timeseries *create_version(const struct tsv_block *b)
+{
+    struct timeseries *ts;
+
+    if(!(ts = malloc(sizeof(struct timeseries))))
+        return NULL;
+    memset(ts, 0, sizeof(struct timeseries));
+    ts->data = b->data;
+    ts->nrecords = b->n;
+    return ts;
+}
+
+/* Adds the block to the pending list, from where publication will move it
+ * to the retired list.
+ */
+static int add_pending(struct ts_versioned *v, struct tsv_block *b)
+{
+    struct tsv_garbage *g;
+
+    if(!(g = malloc(sizeof(struct tsv_garbage))))
+        return errno;
+    g->block = b;
+    g->version = NULL;
+    g->next = v->pending;
+    v->pending = g;
+    return 0;
+}
+
+DLLEXPORT struct ts_versioned *tsv_create(void)
+{
+    struct ts_versioned *v;
+    int i;
+
+    if(!(v = malloc(sizeof(struct ts_versioned))))
+        return NULL;
+    v->epoch = 0;
+    for(i = 0; i < TSV_MAXREADERS; ++i) {
+        v->readers[i].epoch = TSV_IDLE;
+        v->readers[i].in_use = 0;
+    }
+    v->pending = v->retired = NULL;
+    v->current = NULL;
+    if(!(v->block = malloc(sizeof(struct tsv_block))))
+        goto ERROR;
+    v->block->mem = v->block->data = NULL;
+    v->block->size = v->block->n = 0;
+    v->block->owns_flags = 1;
+    if(!(v->current = create_version(v->block)))
+        goto ERROR;
+    return v;
+
+ERROR:
+    free(v->block);
+    free(v);
+    return NULL;
+}
+
+/* No reader may be reading. */
+DLLEXPORT void tsv_free(struct ts_versioned *v)
+{
+    struct tsv_garbage *g, *next;
+
+    if(!v) return;
+    for(g = v->pending; g; g = next) {
+        next = g->next;
+        free_garbage(g);
+    }
+    for(g = v->retired; g; g = next) {
+        next = g->next;
+        free_garbage(g);
+    }
+    free(v->current);
+    free_block(v->block);
+    free(v);
+}
+
+/* The record is staged; it becomes visible to readers on publication. */
+DLLEXPORT int tsv_append(struct ts_versioned *v, long_time_t timestamp,
+        int null, double value, const char *flags, char **errstr)
+{
+    struct tsv_block *b = v->block;
+    struct ts_record *r;
+    char *s;
+
+    if(b->n && timestamp <= b->data[b->n - 1].timestamp) {
+        *errstr = "Record out of order";
+        return EINVAL;
+    }
+    if(b->n == b->size) {
+        struct tsv_block *nb;
+        int size = b->size ? 2*b->size : 64;
+
+        if(!(nb = malloc(sizeof(struct tsv_block))))
+            goto GENFAIL;
+        if(!(nb->mem = malloc(size*sizeof(struct ts_record)))) {
+            free(nb);
+            goto GENFAIL;
+        }
+        if(add_pending(v, b)) {
+            free(nb->mem);
+            free(nb);
+            goto GENFAIL;
+        }
+        if(b->n)
+            memcpy(nb->mem, b->data, b->n*sizeof(struct ts_record));
+        nb->data = nb->mem;
+        nb->size = size;
+        nb->n = b->n;
+        nb->owns_flags = b->owns_flags;
+        b->owns_flags = 0;
+        v->block = b = nb;
+    }
+    if(!(s = strdup(flags)))
+        goto GENFAIL;
+    r = b->data + b->n;
+    r->timestamp = timestamp;
+    r->null = null;
+    r->value = value;
+    r->flags = s;
+    ++(b->n);
+    return 0;
+
+GENFAIL:
+    *errstr = strerror(errno);
+    return errno;
+}
+
+/* Replaces all the records with those of ts (which must have been created
+ * with ts_create, and is freed). This is how changes other than appending
+ * are made: the writer modifies a copy and replaces the original with it.
+ * The change is staged, as with tsv_append.
+ */
+DLLEXPORT int tsv_replace(struct ts_versioned *v, struct timeseries *ts,
+                                                                char **errstr)
+{
+    struct tsv_block *b;
+
+    if(!(b = malloc(sizeof(struct tsv_block))))
+        goto GENFAIL;
+    if(add_pending(v, v->block)) {
+        free(b);
+        goto GENFAIL;
+    }
+    b->mem = ts->data ? ts->data - ts->offset : NULL;
+    b->data = ts->data;
+    b->size = ts->memblocksize/sizeof(struct ts_record) - ts->offset;
+    b->n = ts->nrecords;
+    b->owns_flags = 1;
+    v->block = b;
+    tsindex_free(ts);
+    free(ts);
+    return 0;
+
+GENFAIL:
+    *errstr = strerror(errno);
+    return errno;
+}
+
+/* Makes the staged changes visible and frees what no reader uses any
+ * more.
+ */
+DLLEXPORT int tsv_publish(struct ts_versioned *v, char **errstr)
+{
+    struct timeseries *version;
+    struct tsv_garbage *g, **pg;
+    unsigned long long epoch, min_epoch = TSV_IDLE;
+    int i;
+
+    if(!(g = malloc(sizeof(struct tsv_garbage))))
+        goto GENFAIL;
+    if(!(version = create_version(v->block))) {
+        free(g);
+        goto GENFAIL;
+    }
+    g->block = NULL;
+    g->version = v->current;
+    ATOMIC_STORE(&v->current, version);
+    epoch = ATOMIC_LOAD(&v->epoch);
+    ATOMIC_STORE(&v->epoch, epoch + 1);
+
+    /* Stamp what has been unlinked */
+    g->next = v->pending;
+    v->pending = NULL;
+    while(g) {
+        struct tsv_garbage *next = g->next;
+        g->epoch = epoch;
+        g->next = v->retired;
+        v->retired = g;
+        g = next;
+    }
+
+    for(i = 0; i < TSV_MAXREADERS; ++i) {
+        unsigned long long e = ATOMIC_LOAD(&v->readers[i].epoch);
+        if(e < min_epoch)
+            min_epoch = e;
+    }
+    pg = &v->retired;
+    while(*pg) {
+        g = *pg;
+        if(g->epoch < min_epoch) {
+            *pg = g->next;
+            free_garbage(g);
+        } else
+            pg = &g->next;
+    }
+    return 0;
+
+GENFAIL:
+    *errstr = strerror(errno);
+    return errno;
+}
+
+/* Returns a reader number, to be used by a single thread, or -1 if there
+ * are already TSV_MAXREADERS readers.
+ */
+DLLEXPORT int tsv_reader_register(struct ts_versioned *v)
+{
+    int i;
+
+    for(i = 0; i < TSV_MAXREADERS; ++i)
+        if(claim(&v->readers[i].in_use))
+            return i;
+    return -1;
+}
+
+DLLEXPORT void tsv_reader_unregister(struct ts_versioned *v, int reader)
+{
+    ATOMIC_STORE(&v->readers[reader].epoch, TSV_IDLE);
+    ATOMIC_STORE(&v->readers[reader].in_use, 0);
+}
+
+/* Returns the current version, which remains valid and unchanged until
+ * tsv_read_end. It must not be modified. Calls may not be nested.
+ */
+DLLEXPORT const struct timeseries *tsv_read_begin(struct ts_versioned *v,
+                                                                int reader)
+{
+    ATOMIC_STORE(&v->readers[reader].epoch, ATOMIC_LOAD(&v->epoch));
+    return ATOMIC_LOAD(&v->current);
+}
+
+DLLEXPORT void tsv_read_end(struct ts_versioned *v, int reader)
+{
+    ATOMIC_STORE(&v->readers[reader].epoch, TSV_IDLE);
+}
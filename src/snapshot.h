@@ -0,0 +1,54 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * snapshot.h - time series readable while being written
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _SNAPSHOT_H
+
+#define _SNAPSHOT_H
+
+#include "platform.h"
+#include "dates.h"
+#include "ts.h"
+
+/* A versioned time series has one writer and any number of readers. The
+ * writer stages changes and publishes them as a new version; a reader sees
+ * the version that was current when it began reading, unaffected by later
+ * changes, until it ends reading. Neither readers nor the writer block.
+ */
+struct ts_versioned;
+
+#define TSV_MAXREADERS 256
+
+extern DLLEXPORT struct ts_versioned *tsv_create(void);
+extern DLLEXPORT void tsv_free(struct ts_versioned *v);
+
+/* Writer */
+extern DLLEXPORT int tsv_append(struct ts_versioned *v, long_time_t timestamp,
+        int null, double value, const char *flags, char **errstr);
+extern DLLEXPORT int tsv_replace(struct ts_versioned *v,
+                                    struct timeseries *ts, char **errstr);
+extern DLLEXPORT int tsv_publish(struct ts_versioned *v, char **errstr);
+
+/* Readers */
+extern DLLEXPORT int tsv_reader_register(struct ts_versioned *v);
+extern DLLEXPORT void tsv_reader_unregister(struct ts_versioned *v,
+                                                                int reader);
+extern DLLEXPORT const struct timeseries *tsv_read_begin(
+                                    struct ts_versioned *v, int reader);
+extern DLLEXPORT void tsv_read_end(struct ts_versioned *v, int reader);
+
+#endif /* _SNAPSHOT_H */
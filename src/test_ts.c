@@ -0,0 +1,414 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * test_ts.c - regression tests for the time series operations
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include "dates.h"
+#include "threads.h"
+#include "ts.h"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, \
+                                                        __LINE__, #cond); \
+            ++failures; \
+        } \
+    } while(0)
+
+/* A small deterministic generator, so that failures are reproducible */
+static unsigned long rand_state;
+
+static int next_rand(int n)
+{
+    rand_state = rand_state * 1103515245UL + 12345UL;
+    return (int) ((rand_state >> 16) % 32768UL) % n;
+}
+
+static int il_equal(const struct interval_list *a,
+                                            const struct interval_list *b)
+{
+    int i;
+
+    if(a->n != b->n)
+        return 0;
+    for(i = 0; i < a->n; ++i)
+        if(a->intervals[i].start_date != b->intervals[i].start_date
+                || a->intervals[i].end_date != b->intervals[i].end_date)
+            return 0;
+    return 1;
+}
+
+/* Events */
+
+#define EV_NSERIES 3
+#define EV_NRECORDS 600
+#define EV_STEP 600
+
+/* Appends to the series of tsl the records of step i: runs of wet and dry
+ * steps of random length, shared by the series but with noise and the odd
+ * null value in each.
+ */
+static void append_event_records(struct timeseries_list *tsl, int i,
+                                                                int *wet)
+{
+    char *errstr;
+    int j, recindex;
+
+    if(!next_rand(8))
+        *wet = !*wet;
+    for(j = 0; j < tsl->n; ++j) {
+        int null = !next_rand(40);
+        double value = *wet ? 6 + next_rand(10) : next_rand(7);
+        ts_append_record(tsl->ts[j], (long_time_t) i * EV_STEP, null,
+                                            value, "", &recindex, &errstr);
+    }
+}
+
+static struct timeseries_list *make_event_series(unsigned long seed, int n)
+{
+    struct timeseries_list *tsl = tsl_create();
+    int i, wet = 0;
+
+    rand_state = seed;
+    for(i = 0; i < EV_NSERIES; ++i)
+        tsl_append(tsl, ts_create());
+    for(i = 0; i < n; ++i)
+        append_event_records(tsl, i, &wet);
+    return tsl;
+}
+
+static void free_event_series(struct timeseries_list *tsl)
+{
+    int i;
+
+    for(i = 0; i < tsl->n; ++i)
+        ts_free(tsl->ts[i]);
+    tsl_free(tsl);
+}
+
+/* Returns the number of events that contain a partition boundary of
+ * ts_identify_events_parallel with nparts partitions.
+ */
+static int events_across_boundaries(const struct timeseries *ts,
+                            const struct interval_list *events, int nparts)
+{
+    int i, k, result = 0;
+
+    for(i = 1; i < nparts; ++i) {
+        long_time_t t = ts->data[ts->nrecords * i / nparts].timestamp;
+        for(k = 0; k < events->n; ++k)
+            if(events->intervals[k].start_date < t
+                                    && t <= events->intervals[k].end_date)
+                ++result;
+    }
+    return result;
+}
+
+/* Compares the events found by ts_identify_events_parallel on several
+ * numbers of threads with those of ts_identify_events; returns the number
+ * of events that cross a partition boundary.
+ */
+static int check_events_parallel(const struct timeseries_list *tsl,
+            struct interval range, int reverse, long_time_t separator)
+{
+    static const int nthreads[] = { 2, 3, 5, 8 };
+    double start = reverse ? 2.0 : 10.0;
+    double end = reverse ? 4.0 : 7.0;
+    struct interval_list *serial = il_create();
+    char *errstr;
+    int k, crossing = 0;
+
+    CHECK(ts_identify_events(tsl, range, reverse, start, end, 2, 1,
+                                        separator, serial, &errstr) == 0);
+    CHECK(serial->n > 3);
+    for(k = 0; k < 4; ++k) {
+        struct interval_list *parallel = il_create();
+        dickinson_set_threads(nthreads[k]);
+        CHECK(ts_identify_events_parallel(tsl, range, reverse, start, end,
+                                2, 1, separator, parallel, &errstr) == 0);
+        CHECK(il_equal(serial, parallel));
+        crossing += events_across_boundaries(tsl->ts[0], serial,
+                                                                nthreads[k]);
+        il_free(parallel);
+    }
+    il_free(serial);
+    return crossing;
+}
+
+/* The parallel run must find the same events as the serial one, whatever
+ * the partitions, including events that cross partition boundaries and
+ * events that the time separator joins across them.
+ */
+static void test_events_parallel(void)
+{
+    static const long_time_t separators[] = { 0, 3 * EV_STEP, 10 * EV_STEP };
+    struct timeseries_list *tsl = make_event_series(1, EV_NRECORDS);
+    struct interval all, part;
+    int reverse, s, crossing = 0;
+    int old_threads = dickinson_get_threads();
+    int old_threshold = dickinson_get_parallel_threshold();
+
+    dickinson_set_parallel_threshold(1);
+    all.start_date = LONG_TIME_T_MIN;
+    all.end_date = LONG_TIME_T_MAX;
+    part.start_date = 50 * EV_STEP + 1;
+    part.end_date = 550 * EV_STEP;
+    for(reverse = 0; reverse <= 1; ++reverse)
+        for(s = 0; s < 3; ++s) {
+            crossing += check_events_parallel(tsl, all, reverse,
+                                                            separators[s]);
+            check_events_parallel(tsl, part, reverse, separators[s]);
+        }
+    CHECK(crossing > 0);
+    dickinson_set_threads(old_threads);
+    dickinson_set_parallel_threshold(old_threshold);
+    free_event_series(tsl);
+}
+
+/* Feeds the event detector the records in steps of chunks[0], chunks[1],
+ * ... (cyclically), either appending them to initially empty series (grow)
+ * or with all of them present from the start and only end_date advancing.
+ * After every step, the events must be the batch events found so far, the
+ * last of which may not have ended yet, and first_changed must be the first
+ * event added or extended. Returns the number of steps that extended an
+ * event found in an earlier step.
+ */
+static int check_detector(int reverse, long_time_t separator,
+                                const int *chunks, int nchunks, int grow)
+{
+    double start = reverse ? 2.0 : 10.0;
+    double end = reverse ? 4.0 : 7.0;
+    struct timeseries_list *full = make_event_series(2, EV_NRECORDS);
+    struct timeseries_list *tsl = grow ? make_event_series(2, 0) : full;
+    struct interval_list *batch = il_create();
+    struct interval_list *events = il_create();
+    struct event_detector *ed;
+    struct interval range;
+    char *errstr;
+    int i = 0, c = 0, k, wet = 0, extended = 0;
+
+    range.start_date = LONG_TIME_T_MIN;
+    range.end_date = LONG_TIME_T_MAX;
+    CHECK(ts_identify_events(full, range, reverse, start, end, 2, 1,
+                                        separator, batch, &errstr) == 0);
+    CHECK((ed = ed_create(tsl, reverse, start, end, 2, 1, separator,
+                                                            events)) != NULL);
+    while(i < EV_NRECORDS) {
+        int n = chunks[c++ % nchunks], nbefore = events->n, first_changed;
+        long_time_t last_end = nbefore ?
+                            events->intervals[nbefore-1].end_date : 0;
+        for(; n && i < EV_NRECORDS; --n, ++i)
+            if(grow)
+                append_event_records(tsl, i, &wet);
+        CHECK(ed_update(ed, (long_time_t) (i - 1) * EV_STEP, &first_changed,
+                                                            &errstr) == 0);
+        CHECK(events->n >= nbefore && events->n <= batch->n);
+        for(k = 0; k < events->n && k < batch->n; ++k) {
+            CHECK(events->intervals[k].start_date
+                                    == batch->intervals[k].start_date);
+            if(k < events->n - 1)
+                CHECK(events->intervals[k].end_date
+                                    == batch->intervals[k].end_date);
+            else
+                CHECK(events->intervals[k].end_date
+                                    <= batch->intervals[k].end_date);
+        }
+        if(nbefore && events->intervals[nbefore-1].end_date != last_end) {
+            CHECK(first_changed == nbefore - 1);
+            ++extended;
+        } else
+            CHECK(first_changed == nbefore);
+    }
+    CHECK(ed_update(ed, LONG_TIME_T_MAX, NULL, &errstr) == 0);
+    CHECK(il_equal(events, batch));
+    ed_free(ed);
+    il_free(events);
+    il_free(batch);
+    if(grow)
+        free_event_series(tsl);
+    free_event_series(full);
+    return extended;
+}
+
+/* Feeding the records one at a time or in uneven chunks must give the same
+ * events as a single ts_identify_events call, including events extended
+ * across ed_update calls.
+ */
+static void test_event_detector(void)
+{
+    static const long_time_t separators[] = { 0, 3 * EV_STEP, 10 * EV_STEP };
+    static const int one[] = { 1 };
+    static const int uneven[] = { 1, 7, 2, 31, 3, 1, 12, 5, 64, 1, 1, 9 };
+    int reverse, s, extended = 0;
+
+    for(reverse = 0; reverse <= 1; ++reverse)
+        for(s = 0; s < 3; ++s) {
+            extended += check_detector(reverse, separators[s], one, 1, 1);
+            extended += check_detector(reverse, separators[s], uneven, 12, 1);
+            extended += check_detector(reverse, separators[s], uneven, 12, 0);
+        }
+    CHECK(extended > 0);
+}
+
+/* Upserting */
+
+static struct ts_record make_record(long_time_t timestamp, double value,
+                                                                char *flags)
+{
+    struct ts_record r;
+
+    r.timestamp = timestamp;
+    r.null = 0;
+    r.value = value;
+    r.flags = flags;
+    return r;
+}
+
+/* Checks that ts has n records with the given timestamps, values and flags.
+ */
+static int series_is(const struct timeseries *ts, int n,
+            const long_time_t *timestamps, const double *values,
+            const char *const *flags)
+{
+    int i;
+
+    if(ts->nrecords != n)
+        return 0;
+    for(i = 0; i < n; ++i)
+        if(ts->data[i].timestamp != timestamps[i]
+                    || ts->data[i].value != values[i]
+                    || strcmp(ts->data[i].flags, flags[i]))
+            return 0;
+    return 1;
+}
+
+/* Returns a time series with records at 10, 20 and 30 of values 1, 2 and 3
+ * and flags "A".
+ */
+static struct timeseries *make_upsert_series(void)
+{
+    struct timeseries *ts = ts_create();
+    char *errstr;
+    int i, recindex;
+
+    for(i = 1; i <= 3; ++i)
+        ts_append_record(ts, 10 * i, 0, i, "A", &recindex, &errstr);
+    return ts;
+}
+
+/* Duplicates, both within the batch and against existing records, are
+ * resolved as if the records were inserted one by one: the last one wins
+ * when overwriting, the first one (or the existing record) when skipping,
+ * and they are an error that leaves the series unchanged when inserting.
+ */
+static void test_upsert_policies(void)
+{
+    static const long_time_t original_t[] = { 10, 20, 30 };
+    static const double original_v[] = { 1, 2, 3 };
+    static const char *const original_f[] = { "A", "A", "A" };
+    static const long_time_t merged_t[] = { 5, 10, 15, 20, 30 };
+    static const double overwritten_v[] = { 8, 1, 9, 7, 3 };
+    static const char *const overwritten_f[] = { "", "A", "E", "C", "A" };
+    static const double skipped_v[] = { 8, 1, 6, 2, 3 };
+    static const char *const skipped_f[] = { "", "A", "D", "A", "A" };
+    struct ts_record batch[5];
+    struct ts_record within[3];
+    struct ts_record existing[2];
+    struct timeseries *ts;
+    char *errstr;
+
+    batch[0] = make_record(20, 5, "B");
+    batch[1] = make_record(15, 6, "D");
+    batch[2] = make_record(20, 7, "C");
+    batch[3] = make_record(5, 8, "");
+    batch[4] = make_record(15, 9, "E");
+    within[0] = make_record(15, 6, "");
+    within[1] = make_record(5, 8, "");
+    within[2] = make_record(15, 9, "");
+    existing[0] = make_record(25, 6, "");
+    existing[1] = make_record(20, 7, "");
+
+    ts = make_upsert_series();
+    CHECK(ts_upsert_batch(ts, batch, 5, TS_UPSERT_OVERWRITE, &errstr) == 0);
+    CHECK(series_is(ts, 5, merged_t, overwritten_v, overwritten_f));
+    ts_free(ts);
+
+    ts = make_upsert_series();
+    CHECK(ts_upsert_batch(ts, batch, 5, TS_UPSERT_SKIP, &errstr) == 0);
+    CHECK(series_is(ts, 5, merged_t, skipped_v, skipped_f));
+    ts_free(ts);
+
+    ts = make_upsert_series();
+    CHECK(ts_upsert_batch(ts, batch, 5, TS_UPSERT_INSERT, &errstr) == EINVAL);
+    CHECK(series_is(ts, 3, original_t, original_v, original_f));
+    CHECK(ts_upsert_batch(ts, within, 3, TS_UPSERT_INSERT, &errstr)
+                                                                == EINVAL);
+    CHECK(series_is(ts, 3, original_t, original_v, original_f));
+    CHECK(ts_upsert_batch(ts, existing, 2, TS_UPSERT_INSERT, &errstr)
+                                                                == EINVAL);
+    CHECK(series_is(ts, 3, original_t, original_v, original_f));
+    ts_free(ts);
+}
+
+/* The radix sort must order negative timestamps before positive ones, also
+ * when they differ only in the top byte, and keep duplicates in batch order.
+ */
+static void test_upsert_negative(void)
+{
+    static const long_time_t timestamps[] = {
+        3, -1, 0, LLONG_MAX, -300, 1, -(1LL << 40), 1LL << 40, LLONG_MIN,
+        -2, 256, -256, -300, 1LL << 56, -(1LL << 56), LLONG_MIN + 1, -1 };
+    struct ts_record records[17];
+    struct timeseries *ts = ts_create();
+    char *errstr;
+    int i;
+
+    for(i = 0; i < 17; ++i)
+        records[i] = make_record(timestamps[i], i, "");
+    CHECK(ts_upsert_batch(ts, records, 17, TS_UPSERT_OVERWRITE, &errstr) == 0);
+    CHECK(ts->nrecords == 15);
+    for(i = 1; i < ts->nrecords; ++i)
+        CHECK(ts->data[i-1].timestamp < ts->data[i].timestamp);
+    CHECK(ts->data[0].timestamp == LONG_TIME_T_MIN);
+    CHECK(ts->data[ts->nrecords-1].timestamp == LONG_TIME_T_MAX);
+    for(i = 0; i < ts->nrecords; ++i) {
+        int k = (int) ts->data[i].value;
+        CHECK(timestamps[k] == ts->data[i].timestamp);
+        if(ts->data[i].timestamp == -1)
+            CHECK(k == 16);
+        if(ts->data[i].timestamp == -300)
+            CHECK(k == 12);
+    }
+    ts_free(ts);
+}
+
+int main(void)
+{
+    test_events_parallel();
+    test_event_detector();
+    test_upsert_policies();
+    test_upsert_negative();
+    if(failures)
+        fprintf(stderr, "%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
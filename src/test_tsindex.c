@@ -0,0 +1,123 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * test_tsindex.c - regression tests for the time series indexes
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include "search.h"
+#include "ts.h"
+#include "tsindex.h"
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, \
+                                                        __LINE__, #cond); \
+            ++failures; \
+        } \
+    } while(0)
+
+/* Returns a time series with records at 1..n of value 3, except for the
+ * record at "at", which has the given value.
+ */
+static struct timeseries *make_series(int n, int at, double value)
+{
+    struct timeseries *ts = ts_create();
+    char *errstr;
+    int i, recindex;
+
+    for(i = 1; i <= n; ++i)
+        ts_append_record(ts, i, 0, i == at ? value : 3.0, "", &recindex,
+                                                                    &errstr);
+    return ts;
+}
+
+/* A range that follows an infinite, NaN or overflowing value must not be
+ * affected by it; a range containing it gets what direct summation gives.
+ */
+static void test_sum_after_nonfinite(double value)
+{
+    struct timeseries *ts = make_series(200, 100, value);
+
+    CHECK(ts_attach_sum_index(ts) == 0);
+    CHECK(ts_sum(ts, 101, 101) == 3.0);
+    CHECK(ts_sum(ts, 101, 200) == 300.0);
+    CHECK(ts_average(ts, 150, 160) == 3.0);
+    CHECK(ts_sum(ts, 1, 99) == 297.0);
+    CHECK(ts_count(ts, 1, 200) == 200);
+    if(isnan(value)) {
+        CHECK(isnan(ts_sum(ts, 90, 110)));
+    } else {
+        CHECK(ts_sum(ts, 90, 110) == value + 60.0);
+        CHECK(ts_sum(ts, 100, 100) == value);
+    }
+    ts_free(ts);
+}
+
+/* ts_get_next_i without any index */
+static int next_i_linear(struct timeseries *ts, long_time_t t)
+{
+    int i;
+
+    for(i = 0; i < ts->nrecords && ts->data[i].timestamp < t; ++i)
+        ;
+    return i;
+}
+
+/* Inserting into an indexed time series makes the search index stale
+ * instead of rebuilding it, but searches remain correct throughout.
+ */
+static void test_search_after_insert(void)
+{
+    struct timeseries *ts = ts_create();
+    char *errstr;
+    int i, recindex;
+
+    for(i = 1; i <= 200; ++i)
+        ts_append_record(ts, 2 * i, 0, 1.0, "", &recindex, &errstr);
+    CHECK(ts_attach_search_index(ts, SEARCH_EYTZINGER) == 0);
+    CHECK(ts->search_index->n == 200 && !ts->search_index->stale);
+    for(i = 199; i >= 1; i -= 2) {
+        ts_insert_record(ts, i, 0, 2.0, "", 0, &recindex, &errstr);
+        CHECK(ts_get_next_i(ts, i) == next_i_linear(ts, i));
+        CHECK(ts_get_next_i(ts, 150) == next_i_linear(ts, 150));
+        CHECK(ts_get_next_i(ts, 301) == next_i_linear(ts, 301));
+    }
+    CHECK(ts->search_index->stale);
+    ts_append_record(ts, 401, 0, 1.0, "", &recindex, &errstr);
+    CHECK(ts->search_index->stale);
+    CHECK(ts_get_next_i(ts, 401) == 300);
+    CHECK(ts_update_search_index(ts) == 0);
+    CHECK(ts->search_index->n == 301 && !ts->search_index->stale);
+    for(i = 0; i <= 401; ++i)
+        CHECK(ts_get_next_i(ts, i) == next_i_linear(ts, i));
+    ts_free(ts);
+}
+
+int main(void)
+{
+    test_sum_after_nonfinite(INFINITY);
+    test_sum_after_nonfinite(-INFINITY);
+    test_sum_after_nonfinite(NAN);
+    test_sum_after_nonfinite(1.7e308);
+    test_search_after_insert();
+    if(failures)
+        fprintf(stderr, "%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
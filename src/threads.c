@@ -0,0 +1,258 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * threads.c - parallel execution
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include "threads.h"
+#include "platform.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define MAXTHREADS 256
+#define DEFAULT_PARALLEL_THRESHOLD 131072
+
+static int nthreads = 0;    /* 0 means as many as the processors */
+static int parallel_threshold = DEFAULT_PARALLEL_THRESHOLD;
+
+#ifdef HAVE_PTHREAD_H
+static void stop_pool(void);
+#endif
+
+/* The pool is restarted with the new number of threads when next needed. */
+DLLEXPORT void dickinson_set_threads(int n)
+{
+    nthreads = n < 0 ? 0 : (n > MAXTHREADS ? MAXTHREADS : n);
+#ifdef HAVE_PTHREAD_H
+    stop_pool();
+#endif
+}
+
+DLLEXPORT int dickinson_get_threads(void)
+{
+#if defined(HAVE_PTHREAD_H) && defined(_SC_NPROCESSORS_ONLN)
+    long n;
+
+    if(nthreads)
+        return nthreads;
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (n > MAXTHREADS ? MAXTHREADS : (int) n);
+#elif defined(HAVE_PTHREAD_H)
+    return nthreads ? nthreads : 1;
+#else
+    return 1;
+#endif
+}
+
+DLLEXPORT void dickinson_set_parallel_threshold(int nrecords)
+{
+    parallel_threshold = nrecords;
+}
+
+DLLEXPORT int dickinson_get_parallel_threshold(void)
+{
+    return parallel_threshold;
+}
+
+int parallel_worthwhile(int nrecords)
+{
+    return nrecords >= parallel_threshold && dickinson_get_threads() > 1;
+}
+
+#ifdef HAVE_PTHREAD_H
+
+/* The pool. A parallel_run call queues a job and works on it along with the
+ * pool threads; any idle thread takes the next unclaimed task of the most
+ * recently queued job, so a call made from inside a task (or from several
+ * application threads at once) is served by the same threads instead of
+ * starting more, and nested jobs, whose callers are waiting, are helped
+ * first. A job leaves the queue when its last task is claimed, and its
+ * caller returns when all its tasks have finished. Everything is
+ * protected by one mutex; tasks are coarse enough for that not to matter.
+ *
+ * If an executor has been set, there are no pool threads; instead, each
+ * call submits to the executor nthreads - 1 runs of drain_queue, which
+ * works on the queued jobs until there are none. A run that starts late
+ * finds nothing to do.
+ */
+struct job {
+    void (*task)(void *arg, int i);
+    void *arg;
+    int ntasks;
+    int next;       /* Next task to claim */
+    int unfinished;
+    struct job *next_job;
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static struct job *queue = NULL;   /* Most recent first */
+static pthread_t pool_threads[MAXTHREADS];
+static int pool_size = 0;       /* Number of pool threads running */
+static int pool_started = 0;
+static int pool_stopping = 0;
+static void (*executor)(void (*run)(void *p), void *p, void *ctx) = NULL;
+static void *executor_ctx = NULL;
+
+static void dequeue(struct job *job)
+{
+    struct job **p;
+
+    for(p = &queue; *p; p = &(*p)->next_job)
+        if(*p == job) {
+            *p = job->next_job;
+            break;
+        }
+}
+
+/* Claims and runs one task of the latest queued job, or of job if it is not
+ * NULL; returns zero if there was none. Called and returns with pool_lock
+ * held.
+ */
+static int run_one(struct job *job)
+{
+    int i;
+
+    if(!job)
+        job = queue;
+    if(!job || job->next >= job->ntasks)
+        return 0;
+    i = (job->next)++;
+    if(job->next == job->ntasks)
+        dequeue(job);
+    pthread_mutex_unlock(&pool_lock);
+    job->task(job->arg, i);
+    pthread_mutex_lock(&pool_lock);
+    if(!--(job->unfinished))
+        pthread_cond_broadcast(&pool_done);
+    return 1;
+}
+
+static void *pool_main(void *p)
+{
+    (void) p;
+    pthread_mutex_lock(&pool_lock);
+    while(!pool_stopping)
+        if(!run_one(NULL))
+            pthread_cond_wait(&pool_work, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+    return NULL;
+}
+
+static void drain_queue(void *p)
+{
+    (void) p;
+    pthread_mutex_lock(&pool_lock);
+    while(run_one(NULL))
+        ;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/* Called with pool_lock held. */
+static void start_pool(void)
+{
+    int n = dickinson_get_threads() - 1;
+
+    pool_started = 1;
+    for(pool_size = 0; pool_size < n; ++pool_size)
+        if(pthread_create(pool_threads + pool_size, NULL, pool_main, NULL))
+            break;
+}
+
+/* Must not be called while parallel_run is running. */
+static void stop_pool(void)
+{
+    int t;
+
+    pthread_mutex_lock(&pool_lock);
+    pool_stopping = 1;
+    pthread_cond_broadcast(&pool_work);
+    pthread_mutex_unlock(&pool_lock);
+    for(t = 0; t < pool_size; ++t)
+        pthread_join(pool_threads[t], NULL);
+    pool_size = 0;
+    pool_started = 0;
+    pool_stopping = 0;
+}
+
+DLLEXPORT void dickinson_set_executor(
+        void (*submit)(void (*run)(void *p), void *p, void *ctx), void *ctx)
+{
+    stop_pool();
+    executor = submit;
+    executor_ctx = ctx;
+}
+
+void parallel_run(int ntasks, void (*task)(void *arg, int i), void *arg)
+{
+    struct job job;
+    int t, n = dickinson_get_threads();
+
+    if(n < 2 || ntasks < 2) {
+        for(t = 0; t < ntasks; ++t)
+            task(arg, t);
+        return;
+    }
+    job.task = task;
+    job.arg = arg;
+    job.ntasks = job.unfinished = ntasks;
+    job.next = 0;
+
+    pthread_mutex_lock(&pool_lock);
+    if(!executor && !pool_started)
+        start_pool();
+    job.next_job = queue;
+    queue = &job;
+    if(executor) {
+        pthread_mutex_unlock(&pool_lock);
+        for(t = 1; t < n && t < ntasks; ++t)
+            executor(drain_queue, NULL, executor_ctx);
+        pthread_mutex_lock(&pool_lock);
+    } else
+        pthread_cond_broadcast(&pool_work);
+
+    /* The calling thread works only on its own job, so that it returns as
+     * soon as that has finished.
+     */
+    while(run_one(&job))
+        ;
+    while(job.unfinished)
+        pthread_cond_wait(&pool_done, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+#else
+
+DLLEXPORT void dickinson_set_executor(
+        void (*submit)(void (*run)(void *p), void *p, void *ctx), void *ctx)
+{
+    (void) submit;
+    (void) ctx;
+}
+
+void parallel_run(int ntasks, void (*task)(void *arg, int i), void *arg)
+{
+    int i;
+
+    for(i = 0; i < ntasks; ++i)
+        task(arg, i);
+}
+
+#endif
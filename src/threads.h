@@ -0,0 +1,53 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * threads.h - parallel execution
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _THREADS_H
+
+#define _THREADS_H
+
+#include "platform.h"
+
+extern DLLEXPORT void dickinson_set_threads(int nthreads);
+extern DLLEXPORT int dickinson_get_threads(void);
+extern DLLEXPORT void dickinson_set_parallel_threshold(int nrecords);
+extern DLLEXPORT int dickinson_get_parallel_threshold(void);
+
+/* Runs the parallel work on the application's threads instead of the
+ * library's: submit(run, p, ctx) must arrange for run(p) to be called soon,
+ * on any thread. NULL restores the library's pool.
+ */
+extern DLLEXPORT void dickinson_set_executor(
+        void (*submit)(void (*run)(void *p), void *p, void *ctx), void *ctx);
+
+/* Used internally. */
+
+/* Runs task(arg, i) for i = 0..ntasks-1, on the calling thread and the
+ * library's thread pool (started on first use, with one thread less than
+ * configured), and returns when all have finished. The tasks must be
+ * independent; they may themselves call parallel_run. If threads are not
+ * available, they are run serially by the calling thread.
+ */
+extern void parallel_run(int ntasks, void (*task)(void *arg, int i),
+                                                                void *arg);
+
+/* Returns nonzero if an operation over nrecords records is worth
+ * parallelizing.
+ */
+extern int parallel_worthwhile(int nrecords);
+
+#endif /* _THREADS_H */
@@ -26,24 +26,60 @@
 #include "csv.h"
 #include "dates.h"
 #include "ts.h"
+#include "dl.h"
+#include "tsindex.h"
+#include "heap.h"
+#include "threads.h"
+#include "search.h"
 #include "platform.h"
 
 /* Makes sure that the data block allocated for the timeseries data is of
  * a size suitable for the specified number of records, and if necessary it
  * reallocs it in order to enlarge it or shrink it. Returns nonzero on
- * insufficient memory.
+ * insufficient memory. Records trimmed from the head of the time series
+ * (ts->offset) are reclaimed here, by moving the records to the start of
+ * the block, only when the block would otherwise need to be realloced.
  */
 #define RESERVEDSIZE 100000
+
+/* Moves the records to the start of the memory block, so that data is again
+ * the pointer returned by malloc.
+ */
+DLLEXPORT void ts_compact(struct timeseries *ts)
+{
+    struct ts_record *block;
+
+    if(!ts->offset)
+        return;
+    block = ts->data - ts->offset;
+    memmove(block, ts->data, ts->nrecords * sizeof(struct ts_record));
+    ts->data = block;
+    ts->offset = 0;
+}
+
+/* Resizes the memory block for nrecords records; the offset is dropped when
+ * there are none, so that it is zero whenever the time series is empty.
+ */
 static int check_block_size(struct timeseries *ts, int nrecords)
 {
     void *p;
     size_t required_size, new_size;
 
-    required_size = nrecords * sizeof(struct ts_record);
+    if(!nrecords)
+        ts_compact(ts);
+    required_size = (ts->offset + nrecords) * sizeof(struct ts_record);
     if((ts->memblocksize >= required_size)
             && (ts->memblocksize < required_size + 2 * RESERVEDSIZE)) {
         return 0;
     }
+    if(ts->offset) {
+        ts_compact(ts);
+        required_size = nrecords * sizeof(struct ts_record);
+        if((ts->memblocksize >= required_size)
+                && (ts->memblocksize < required_size + 2 * RESERVEDSIZE)) {
+            return 0;
+        }
+    }
 
     new_size = required_size + RESERVEDSIZE;
     p = realloc(ts->data, new_size);
@@ -71,6 +107,7 @@ DLLEXPORT int ts_set_item(struct timeseries *ts, int index,
     r->null = null;
     r->value = value;
     r->flags = s;
+    tsindex_record_updated(ts, index);
     return 0;
 
 GENFAIL:
@@ -98,6 +135,7 @@ DLLEXPORT int ts_append_record(struct timeseries *ts, long_time_t timestamp,
     r->null = null;
     r->value = value;
     r->flags = s;
+    tsindex_records_appended(ts);
     return 0;
 
 GENFAIL:
@@ -141,6 +179,7 @@ DLLEXPORT int ts_insert_record(struct timeseries *ts, long_time_t timestamp,
     r->null = null;
     r->value = value;
     r->flags = s;
+    tsindex_records_changed(ts, next_item);
     return 0;
 
 GENFAIL:
@@ -152,9 +191,15 @@ DLLEXPORT struct ts_record *ts_get_next(const struct timeseries *ts,
                                                         long_time_t timestamp)
 {
     struct ts_record *low, *high, *mid;
+    int i;
 
     if(!ts->nrecords)
         return NULL;
+    if(ts->search_index) {
+        i = search_lower_bound(ts->search_index, &ts->data->timestamp,
+                            sizeof(struct ts_record), ts->nrecords, timestamp);
+        return i < ts->nrecords ? ts->data + i : NULL;
+    }
     low = ts->data;
     high = ts->data + (ts->nrecords - 1);
     while(low<=high) {
@@ -216,6 +261,59 @@ DLLEXPORT int ts_get_i(const struct timeseries *ts, long_time_t timestamp)
     return r ? r - ts->data : -1;
 }
 
+/* Cursors */
+
+DLLEXPORT void ts_cursor_init(struct ts_cursor *c, const struct timeseries *ts)
+{
+    c->ts = ts;
+    c->index = 0;
+}
+
+DLLEXPORT struct ts_record *ts_cursor_get(const struct ts_cursor *c)
+{
+    if(c->index < 0 || c->index >= c->ts->nrecords)
+        return NULL;
+    return c->ts->data + c->index;
+}
+
+DLLEXPORT struct ts_record *ts_cursor_next(struct ts_cursor *c)
+{
+    if(c->index < c->ts->nrecords)
+        ++(c->index);
+    return ts_cursor_get(c);
+}
+
+DLLEXPORT struct ts_record *ts_cursor_prev(struct ts_cursor *c)
+{
+    if(c->index >= 0)
+        --(c->index);
+    return ts_cursor_get(c);
+}
+
+DLLEXPORT struct ts_record *ts_cursor_seek_next(struct ts_cursor *c,
+                                                        long_time_t timestamp)
+{
+    c->index = search_gallop(c->ts->data ? &c->ts->data->timestamp : NULL,
+            sizeof(struct ts_record), c->ts->nrecords, c->index, timestamp);
+    return ts_cursor_get(c);
+}
+
+DLLEXPORT struct ts_record *ts_cursor_seek_prev(struct ts_cursor *c,
+                                                        long_time_t timestamp)
+{
+    struct ts_record *r = ts_cursor_seek_next(c, timestamp);
+    if(!r || r->timestamp != timestamp)
+        --(c->index);
+    return ts_cursor_get(c);
+}
+
+DLLEXPORT struct ts_record *ts_cursor_seek(struct ts_cursor *c,
+                                                        long_time_t timestamp)
+{
+    struct ts_record *r = ts_cursor_seek_next(c, timestamp);
+    return (r && r->timestamp==timestamp) ? r : NULL;
+}
+
 DLLEXPORT int ts_delete_item(struct timeseries *ts, int index)
 {
     struct ts_record *r = ts->data + index;
@@ -237,8 +335,48 @@ DLLEXPORT struct ts_record *ts_delete_records(struct timeseries *ts,
     }
     memmove(r1, r2+1, (end-r2)*sizeof(struct ts_record));
     ts->nrecords -= r2-r1+1;
+    tsindex_records_changed(ts, r1-start);
     i = check_block_size(ts, ts->nrecords); if(i) return NULL;
-    return r1;
+    return ts->data + (r1-start);
+}
+
+DLLEXPORT int ts_delete_range(struct timeseries *ts, long_time_t start_date,
+                                                        long_time_t end_date)
+{
+    struct ts_record *r;
+    int i1 = ts_get_next_i(ts, start_date);
+    int i2 = ts_get_prev_i(ts, end_date);
+    int n;
+
+    if(i1<0 || i2<i1)
+        return 0;
+    n = i2 - i1 + 1;
+    for(r = ts->data + i1; r <= ts->data + i2; ++r) {
+        free(r->flags);
+        r->flags = NULL;
+    }
+    if(i1==0) {
+        /* Trim the head; the block is compacted later by check_block_size */
+        ts->data += n;
+        ts->offset += n;
+        ts->nrecords -= n;
+        if(!ts->nrecords)
+            check_block_size(ts, 0);
+    } else {
+        memmove(ts->data + i1, ts->data + i2 + 1,
+                            (ts->nrecords - i2 - 1) * sizeof(struct ts_record));
+        ts->nrecords -= n;
+        check_block_size(ts, ts->nrecords);
+    }
+    tsindex_records_changed(ts, i1);
+    return n;
+}
+
+DLLEXPORT int ts_trim_head(struct timeseries *ts, long_time_t before)
+{
+    if(before==LONG_TIME_T_MIN)
+        return 0;
+    return ts_delete_range(ts, LONG_TIME_T_MIN, before - 1);
 }
 
 DLLEXPORT int ts_delete_record(struct timeseries *ts, long_time_t tm)
@@ -259,13 +397,20 @@ DLLEXPORT struct timeseries *ts_create(void)
     ts->nrecords = 0;
     ts->data = NULL;
     ts->memblocksize = 0;
+    ts->offset = 0;
+    ts->search_index = NULL;
+    ts->sum_index = NULL;
+    ts->minmax_index = NULL;
+    ts->quantile_index = NULL;
     return ts;
 }
 
 DLLEXPORT void ts_free(struct timeseries *ts)
 {
     ts_clear(ts);
-    free(ts->data);
+    tsindex_free(ts);
+    if(ts->data)
+        free(ts->data - ts->offset);
     ts->data=NULL;
     free(ts);
 }
@@ -284,6 +429,7 @@ DLLEXPORT void ts_clear(struct timeseries *ts)
         r->flags = NULL;
     }
     ts->nrecords = 0;
+    tsindex_records_changed(ts, 0);
     check_block_size(ts, ts->nrecords);
 }
 
@@ -423,10 +569,45 @@ DLLEXPORT int ts_readfromstring(char *string, struct timeseries *ts,
     return retval;
 }
 
+/* Checks whether the n records can be merged into ts with ts_merge, and
+ * sets *index to the ts record before which they will go. Returns 0 or
+ * EINVAL.
+ */
+static int check_merge(const struct timeseries *ts,
+            const struct ts_record *records, int n, int *index, char **errstr)
+{
+    int i1, i2;
+
+    /* Find record i1 before which first record will be inserted. */
+    if((i1 = ts_get_next_i(ts, records[0].timestamp))<0)
+        i1 = ts->nrecords;
+
+    /* Find record i2 before which last record will be inserted. */
+    if((i2 = ts_get_next_i(ts, records[n-1].timestamp))<0)
+        i2 = ts->nrecords;
+
+    /* All records should go in the same place. */
+    if(i1 != i2) {
+        *errstr = "No record intermixing allowed when merging timeseries";
+        return EINVAL;
+    }
+
+    /* No overwriting allowed either. */
+    if(i1<ts->nrecords &&
+    ((ts->data[i1].timestamp==records[0].timestamp) ||
+    (ts->data[i1].timestamp==records[n-1].timestamp)))
+    {
+        *errstr = "No record overwriting allowed when merging timeseries";
+        return EINVAL;
+    }
+    *index = i1;
+    return 0;
+}
+
 DLLEXPORT int ts_merge(struct timeseries *ts1, struct timeseries *ts2,
                             char **errstr)
 {
-    int i, i1, i2;
+    int i, i1;
     struct ts_record *r1;
     struct ts_record r2;
     char *s;
@@ -450,31 +631,12 @@ DLLEXPORT int ts_merge(struct timeseries *ts1, struct timeseries *ts2,
             s = strdup(r2.flags); if(!s) goto GENFAIL;
             r1->flags = s;
         }
+        tsindex_records_appended(ts1);
         return 0;
     }
 
-    /* Find record i1 before which first ts2 record will be inserted. */
-    if((i1 = ts_get_next_i(ts1, ts2->data[0].timestamp))<0)
-        i1 = ts1->nrecords;
-
-    /* Find record i2 before which last ts2 record will be inserted. */
-    if((i2 = ts_get_next_i(ts1, ts2->data[ts2->nrecords-1].timestamp))<0)
-        i2 = ts1->nrecords;
-
-    /* All ts2 should go in the same place. */
-    if(i1 != i2) {
-        *errstr = "No record intermixing allowed when merging timeseries";
-        return EINVAL;
-    }
-
-    /* No overwriting allowed either. */
-    if(i1<ts1->nrecords &&
-    ((ts1->data[i1].timestamp==ts2->data[0].timestamp) ||
-    (ts1->data[i1].timestamp==ts2->data[ts2->nrecords-1].timestamp)))
-    {
-        *errstr = "No record overwriting allowed when merging timeseries";
-        return EINVAL;
-    }
+    if((i = check_merge(ts1, ts2->data, ts2->nrecords, &i1, errstr)))
+        return i;
 
     /* OK, proceed with the merging. */
     if(check_block_size(ts1, ts1->nrecords + ts2->nrecords)) goto GENFAIL;
@@ -491,6 +653,7 @@ DLLEXPORT int ts_merge(struct timeseries *ts1, struct timeseries *ts2,
         r1->flags = s;
     }
     ts1->nrecords += ts2->nrecords;
+    tsindex_records_changed(ts1, i1);
 
     return 0;
 
@@ -499,17 +662,292 @@ GENFAIL:
     return errno;
 }
 
+/* Moves the n records (which must not be in ts) into ts with the rules of
+ * ts_merge; ts takes over their flags.
+ */
+static int merge_move_records(struct timeseries *ts, struct ts_record *records,
+                                                        int n, char **errstr)
+{
+    int i, i1;
+
+    if((i = check_merge(ts, records, n, &i1, errstr)))
+        return i;
+    if(check_block_size(ts, ts->nrecords + n)) {
+        *errstr = strerror(errno);
+        return errno;
+    }
+    memmove(ts->data + i1 + n, ts->data + i1,
+            (ts->nrecords - i1) * sizeof(struct ts_record));
+    memcpy(ts->data + i1, records, n * sizeof(struct ts_record));
+    ts->nrecords += n;
+    tsindex_records_changed(ts, i1);
+    return 0;
+}
+
+DLLEXPORT void ts_swap(struct timeseries *ts1, struct timeseries *ts2)
+{
+    struct timeseries t = *ts1;
+    *ts1 = *ts2;
+    *ts2 = t;
+}
+
+DLLEXPORT int ts_merge_move(struct timeseries *ts1, struct timeseries *ts2,
+                                                                char **errstr)
+{
+    int result;
+
+    if(!ts2->nrecords)
+        return 0;
+
+    /* Special case: ts1 empty; exchange the data blocks. */
+    if(!ts1->nrecords) {
+        struct ts_record *data = ts1->data;
+        size_t memblocksize = ts1->memblocksize;
+        int offset = ts1->offset;
+        ts1->data = ts2->data;
+        ts1->memblocksize = ts2->memblocksize;
+        ts1->offset = ts2->offset;
+        ts1->nrecords = ts2->nrecords;
+        ts2->data = data;
+        ts2->memblocksize = memblocksize;
+        ts2->offset = offset;
+        ts2->nrecords = 0;
+        tsindex_records_changed(ts1, 0);
+        tsindex_records_changed(ts2, 0);
+        return 0;
+    }
+
+    if((result = merge_move_records(ts1, ts2->data, ts2->nrecords, errstr)))
+        return result;
+    ts2->nrecords = 0;
+    tsindex_records_changed(ts2, 0);
+    check_block_size(ts2, 0);
+    return 0;
+}
+
+DLLEXPORT int ts_steal_range(struct timeseries *dest, struct timeseries *src,
+            long_time_t start_date, long_time_t end_date, char **errstr)
+{
+    int i1 = ts_get_next_i(src, start_date);
+    int i2 = ts_get_prev_i(src, end_date);
+    int n, result;
+
+    if(i1<0 || i2<i1)
+        return 0;
+    n = i2 - i1 + 1;
+    if(n==src->nrecords)
+        return ts_merge_move(dest, src, errstr);
+    if((result = merge_move_records(dest, src->data + i1, n, errstr)))
+        return result;
+    memmove(src->data + i1, src->data + i2 + 1,
+                            (src->nrecords - i2 - 1) * sizeof(struct ts_record));
+    src->nrecords -= n;
+    tsindex_records_changed(src, i1);
+    check_block_size(src, src->nrecords);
+    return 0;
+}
+
+/* Merges into ts the n records records[order[0]], records[order[1]], ...
+ * (or records[0], records[1], ... if order is NULL), which must be in order
+ * of timestamp without duplicates. A record whose timestamp exists in ts
+ * replaces the existing one if policy is TS_UPSERT_OVERWRITE, is ignored if
+ * TS_UPSERT_SKIP, and is an error if TS_UPSERT_INSERT. The records are
+ * merged from the end backwards, so that the records of ts can be moved in
+ * place after the data block is enlarged once. The flags are copied
+ * beforehand, so that ts is unchanged on failure.
+ */
+static int merge_records(struct timeseries *ts,
+            const struct ts_record *records, const int *order, int n,
+            int policy, char **errstr)
+{
+    char **flags = NULL;
+    const struct ts_record *r;
+    int i, j, k, first, nrecords;
+    int result = 0;
+
+    if(!n)
+        return 0;
+    if(!(flags = calloc(n, sizeof(char *)))) goto GENFAIL;
+
+    /* Find the final size, nrecords, and the first record affected, first,
+     * and copy the flags of the records that will be used.
+     */
+    nrecords = ts->nrecords + n;
+    if((first = ts_get_next_i(ts, records[order ? order[0] : 0].timestamp))<0)
+        first = ts->nrecords;
+    for(i = 0, j = 0; j < n; ++j) {
+        r = records + (order ? order[j] : j);
+        while(i < ts->nrecords && ts->data[i].timestamp < r->timestamp)
+            ++i;
+        if(i < ts->nrecords && ts->data[i].timestamp == r->timestamp) {
+            --nrecords;
+            if(policy == TS_UPSERT_INSERT) {
+                result = EINVAL;
+                *errstr = "Record already exists";
+                goto END;
+            }
+            if(policy == TS_UPSERT_SKIP)
+                continue;
+        }
+        if(!(flags[j] = strdup(r->flags))) goto GENFAIL;
+    }
+    if(check_block_size(ts, nrecords)) goto GENFAIL;
+
+    i = ts->nrecords - 1;
+    j = n - 1;
+    for(k = nrecords - 1; j >= 0; --k) {
+        r = records + (order ? order[j] : j);
+        if(i >= 0 && ts->data[i].timestamp > r->timestamp) {
+            ts->data[k] = ts->data[i--];
+            continue;
+        }
+        if(i >= 0 && ts->data[i].timestamp == r->timestamp) {
+            if(!flags[j]) {
+                /* Skipped */
+                ts->data[k] = ts->data[i--];
+                --j;
+                continue;
+            }
+            free(ts->data[i--].flags);
+        }
+        ts->data[k].timestamp = r->timestamp;
+        ts->data[k].null = r->null;
+        ts->data[k].value = r->value;
+        ts->data[k].flags = flags[j];
+        flags[j--] = NULL;
+    }
+    ts->nrecords = nrecords;
+    tsindex_records_changed(ts, first);
+
+END:
+    if(flags)
+        for(j = 0; j < n; ++j)
+            free(flags[j]);
+    free(flags);
+    return result;
+
+GENFAIL:
+    result = errno;
+    *errstr = strerror(errno);
+    goto END;
+}
+
 DLLEXPORT int ts_merge_anyway(struct timeseries *ts1,
                                 const struct timeseries *ts2, char **errstr)
 {
-    struct ts_record *r;
-    int result, dummy;
+    if(ts1==ts2)
+        return 0;
+    return merge_records(ts1, ts2->data, NULL, ts2->nrecords,
+                                                TS_UPSERT_OVERWRITE, errstr);
+}
 
-    for(r=ts2->data; r < ts2->data + ts2->nrecords; ++r)
-        if((result = ts_insert_record(ts1, r->timestamp, r->null, r->value,
-                                                r->flags, 1, &dummy, errstr)))
-            return result;
-    return 0;
+/* Sets order to the indexes of the records sorted by timestamp; the sort is
+ * stable. It is an LSD radix sort on the bytes of the timestamps (with the
+ * sign bit flipped so that they sort as unsigned), skipping the bytes in
+ * which all timestamps are equal. Returns zero or errno.
+ */
+static int sort_records(const struct ts_record *records, int n, int *order)
+{
+    unsigned long long *keys = NULL, *keys2 = NULL, *tk;
+    int *order2 = NULL, *from, *to, *t;
+    int count[256];
+    int i, shift, sorted = 1;
+    int result = 0;
+
+    for(i = 0; i < n; ++i) {
+        order[i] = i;
+        if(i && records[i].timestamp < records[i-1].timestamp)
+            sorted = 0;
+    }
+    if(sorted)
+        return 0;
+    if(!(keys = malloc(n * sizeof(unsigned long long)))) goto GENFAIL;
+    if(!(keys2 = malloc(n * sizeof(unsigned long long)))) goto GENFAIL;
+    if(!(order2 = malloc(n * sizeof(int)))) goto GENFAIL;
+    for(i = 0; i < n; ++i)
+        keys[i] = (unsigned long long) records[i].timestamp ^ (1ULL << 63);
+    from = order;
+    to = order2;
+    for(shift = 0; shift < 64; shift += 8) {
+        int sum = 0;
+        memset(count, 0, sizeof(count));
+        for(i = 0; i < n; ++i)
+            ++count[(keys[i] >> shift) & 0xff];
+        if(count[(keys[0] >> shift) & 0xff] == n)
+            continue;
+        for(i = 0; i < 256; ++i) {
+            int c = count[i];
+            count[i] = sum;
+            sum += c;
+        }
+        for(i = 0; i < n; ++i) {
+            int pos = count[(keys[i] >> shift) & 0xff]++;
+            keys2[pos] = keys[i];
+            to[pos] = from[i];
+        }
+        tk = keys; keys = keys2; keys2 = tk;
+        t = from; from = to; to = t;
+    }
+    if(from != order)
+        memcpy(order, from, n * sizeof(int));
+
+END:
+    free(keys);
+    free(keys2);
+    free(order2);
+    return result;
+
+GENFAIL:
+    result = errno;
+    goto END;
+}
+
+DLLEXPORT int ts_upsert_batch(struct timeseries *ts,
+                    const struct ts_record *records, int n, int policy,
+                    char **errstr)
+{
+    int *order = NULL;
+    int i, j, result = 0;
+
+    if(policy != TS_UPSERT_INSERT && policy != TS_UPSERT_OVERWRITE
+                                            && policy != TS_UPSERT_SKIP) {
+        *errstr = "Invalid upsert policy";
+        return EINVAL;
+    }
+    if(n <= 0)
+        return 0;
+    if(!(order = malloc(n * sizeof(int)))) goto GENFAIL;
+    if((result = sort_records(records, n, order))) {
+        *errstr = strerror(result);
+        goto END;
+    }
+
+    /* Remove duplicates, as if the records were inserted one by one: the
+     * last one wins when overwriting, the first one when skipping.
+     */
+    for(i = 0, j = 0; i < n; ++i) {
+        if(j && records[order[j-1]].timestamp == records[order[i]].timestamp) {
+            if(policy == TS_UPSERT_INSERT) {
+                result = EINVAL;
+                *errstr = "Record already exists";
+                goto END;
+            }
+            if(policy == TS_UPSERT_OVERWRITE)
+                order[j-1] = order[i];
+            continue;
+        }
+        order[j++] = order[i];
+    }
+    result = merge_records(ts, records, order, j, policy, errstr);
+
+END:
+    free(order);
+    return result;
+
+GENFAIL:
+    result = errno;
+    *errstr = strerror(errno);
+    goto END;
 }
 
 DLLEXPORT int ts_writeline(struct ts_record *r, int precision, char *str,
@@ -606,6 +1044,7 @@ DLLEXPORT struct timeseries_list *tsl_create(void)
     if(!(tsl = malloc(sizeof(struct timeseries_list))))
         return NULL;
     tsl->n = 0;
+    tsl->size = 0;
     tsl->ts = NULL;
     return tsl;
 }
@@ -620,10 +1059,14 @@ DLLEXPORT void tsl_free(struct timeseries_list *tsl)
 
 DLLEXPORT int tsl_append(struct timeseries_list *tsl, struct timeseries *t)
 {
-    struct timeseries **p = realloc(tsl->ts,
-									(tsl->n + 1)*sizeof(struct timeseries *));
-    if(p==NULL) return errno;
-    tsl->ts = p;
+    if(tsl->n >= tsl->size) {
+        int size = tsl->size ? 2*tsl->size : 16;
+        struct timeseries **p = realloc(tsl->ts,
+                                        size*sizeof(struct timeseries *));
+        if(p==NULL) return errno;
+        tsl->ts = p;
+        tsl->size = size;
+    }
     tsl->ts[(tsl->n)++] = t;
     return 0;
 }
@@ -633,19 +1076,25 @@ DLLEXPORT int tsl_delete(struct timeseries_list *tsl, int index)
     if(index >= tsl->n || index<0)
         return EINVAL;
     memmove(tsl->ts + index, tsl->ts + (index + 1), 
-                            (tsl->n - index - 1)*sizeof(struct timeseries));
-    tsl->ts = realloc(tsl->ts, (--(tsl->n))*sizeof(struct timeseries));
+                            (tsl->n - index - 1)*sizeof(struct timeseries *));
+    --(tsl->n);
     return 0;
 }
 
-DLLEXPORT double ts_min(struct timeseries *ts, long_time_t start_date,
+DLLEXPORT double ts_min(const struct timeseries *ts, long_time_t start_date,
                                                         long_time_t end_date)
 {
     double result = NAN;
+    double other;
     struct ts_record *r = ts_get_next(ts, start_date);
     struct ts_record *end = ts_get_prev(ts, end_date);
     if(!r || !end)
         return result;
+    if(ts->minmax_index && r<=end) {
+        if(tsindex_range_minmax(ts, r-ts->data, end-ts->data, &result, &other))
+            return NAN;
+        return result;
+    }
     while(r<=end) {
         if(!(r->null))
             result = isnan(result) ? r->value : fmin(result, r->value);
@@ -654,14 +1103,20 @@ DLLEXPORT double ts_min(struct timeseries *ts, long_time_t start_date,
     return result;
 }
 
-DLLEXPORT double ts_max(struct timeseries *ts, long_time_t start_date,
+DLLEXPORT double ts_max(const struct timeseries *ts, long_time_t start_date,
                                                         long_time_t end_date)
 {
     double result = NAN;
+    double other;
     struct ts_record *r = ts_get_next(ts, start_date);
     struct ts_record *end = ts_get_prev(ts, end_date);
     if(!r || !end)
         return result;
+    if(ts->minmax_index && r<=end) {
+        if(tsindex_range_minmax(ts, r-ts->data, end-ts->data, &other, &result))
+            return NAN;
+        return result;
+    }
     while(r<=end) {
         if(!(r->null))
             result = isnan(result) ? r->value : fmax(result, r->value);
@@ -670,7 +1125,7 @@ DLLEXPORT double ts_max(struct timeseries *ts, long_time_t start_date,
     return result;
 }
 
-DLLEXPORT double ts_average(struct timeseries *ts, long_time_t start_date,
+DLLEXPORT double ts_average(const struct timeseries *ts, long_time_t start_date,
                                                         long_time_t end_date)
 {
     double sum = 0.0;
@@ -679,6 +1134,11 @@ DLLEXPORT double ts_average(struct timeseries *ts, long_time_t start_date,
     int divider = 0;
     if(!r || !end)
         return NAN;
+    if(ts->sum_index && r<=end) {
+        if(tsindex_range_sum(ts, r-ts->data, end-ts->data, &sum, &divider))
+            return NAN;
+        return divider ? sum/divider : NAN;
+    }
     while(r<=end) {
         if(!(r->null)) {
             sum += r->value;
@@ -689,14 +1149,20 @@ DLLEXPORT double ts_average(struct timeseries *ts, long_time_t start_date,
     return divider ? sum/divider : NAN;
 }
 
-DLLEXPORT double ts_sum(struct timeseries *ts, long_time_t start_date,
+DLLEXPORT double ts_sum(const struct timeseries *ts, long_time_t start_date,
                                                         long_time_t end_date)
 {
     double result = NAN;
     struct ts_record *r = ts_get_next(ts, start_date);
     struct ts_record *end = ts_get_prev(ts, end_date);
+    int count;
     if(!r || !end)
         return NAN;
+    if(ts->sum_index && r<=end) {
+        if(tsindex_range_sum(ts, r-ts->data, end-ts->data, &result, &count))
+            return NAN;
+        return count ? result : NAN;
+    }
     while(r<=end) {
         if(!(r->null))
             result = isnan(result) ? r->value : result + r->value;
@@ -705,6 +1171,24 @@ DLLEXPORT double ts_sum(struct timeseries *ts, long_time_t start_date,
     return result;
 }
 
+DLLEXPORT int ts_count(const struct timeseries *ts, long_time_t start_date,
+                                                        long_time_t end_date)
+{
+    struct ts_record *r = ts_get_next(ts, start_date);
+    struct ts_record *end = ts_get_prev(ts, end_date);
+    double sum;
+    int result = 0;
+    if(!r || !end || r>end)
+        return 0;
+    if(ts->sum_index
+            && !tsindex_range_sum(ts, r-ts->data, end-ts->data, &sum, &result))
+        return result;
+    for(result = 0; r<=end; ++r)
+        if(!(r->null))
+            ++result;
+    return result;
+}
+
 /* ts_identify_events */
 
 /* The function uses state-transition. The state data are in struct state_data.
@@ -717,10 +1201,19 @@ DLLEXPORT double ts_sum(struct timeseries *ts, long_time_t start_date,
  */
 
 struct state_data {
-    struct timeseries_list *ts;
-    struct timeseries *all_timestamps; /* All timestamps of all ts merged. */
-    struct ts_record *current_record;  /* Pointer in all_timestamps. */
+    const struct timeseries_list *ts;
+    struct datetimelist *all_timestamps; /* All timestamps of all ts merged */
+    long_time_t *current_timestamp;    /* Pointer in all_timestamps. */
+    int *cursors;        /* For each ts, index of first record at or after
+                            current_timestamp; they only move forward. */
     void (*state)(struct state_data *);/* The current state. */
+    void (*resume)(struct state_data *);/* State to continue from when more
+                                           timestamps become available. */
+    unsigned char *quiet;  /* If not NULL, quiet[i] is set when timestamp i
+                              is examined while not in event. */
+    const unsigned char *sync; /* If not NULL, stop when examining, while not
+                                  in event, a timestamp i with sync[i] set. */
+    int synced;                /* Whether it stopped because of sync. */
     int result;                        /* Stays at 0 until finding error. */
     struct interval range;             
     int reverse;
@@ -734,88 +1227,132 @@ struct state_data {
 static int num_of_timeseries_crossing_threshold(struct state_data *sd,
                                                 double threshold)
 {
-    struct timeseries **tp = sd->ts->ts;
+    long_time_t t = *(sd->current_timestamp);
     int result = 0;
     int sign = sd->reverse ? -1 : 1;
-    for(tp = sd->ts->ts; tp < sd->ts->ts + sd->ts->n; ++tp) {
-        struct ts_record *r = ts_get(*tp, sd->current_record->timestamp);
-        if(r && !r->null && sign*r->value > sign*threshold)
+    int i;
+    for(i = 0; i < sd->ts->n; ++i) {
+        struct timeseries *ts = sd->ts->ts[i];
+        struct ts_record *r;
+        while(sd->cursors[i] < ts->nrecords
+                                && ts->data[sd->cursors[i]].timestamp < t)
+            ++(sd->cursors[i]);
+        if(sd->cursors[i] >= ts->nrecords)
+            continue;
+        r = ts->data + sd->cursors[i];
+        if(r->timestamp == t && !r->null && sign*r->value > sign*threshold)
             ++result;
     }
     return result;
 }
 
+/* Sets sd->all_timestamps to the union of the time stamps of all the time
+ * series within [start_date, end_date], and points the cursors to the first
+ * record at or after start_date. all_timestamps and the cursors are allocated
+ * if NULL, otherwise reused. It is made by a k-way merge of the time series,
+ * which are already sorted. Returns zero or errno.
+ */
+static int merge_timestamps(struct state_data *sd, long_time_t start_date,
+                                                        long_time_t end_date)
+{
+    struct datetimelist *tmstmps;
+    struct timeseries *t;
+    struct kmerge km;
+    long_time_t timestamp;
+    int i, first, last, total = 0;
+    int n = sd->ts->n;
+    int result = 0;
+
+    if((result = kmerge_init(&km, n, sizeof(struct ts_record))))
+        return result;
+    if(!sd->all_timestamps && (sd->all_timestamps = dl_create())==NULL)
+        goto GENFAIL;
+    tmstmps = sd->all_timestamps;
+    dl_clear(tmstmps);
+    if(n && !sd->cursors && !(sd->cursors = malloc(n * sizeof(int))))
+        goto GENFAIL;
+    for(i = 0; i < n; ++i) {
+        t = sd->ts->ts[i];
+        first = ts_get_next_i(t, start_date);
+        last = ts_get_prev_i(t, end_date);
+        if(first < 0)
+            first = t->nrecords;
+        sd->cursors[i] = first;
+        if(last < first)
+            continue;
+        total += last - first + 1;
+        kmerge_add(&km, i, &t->data->timestamp, first, last + 1);
+    }
+    if(dl_reserve(tmstmps, total)) goto GENFAIL;
+    while(kmerge_next(&km, &timestamp))
+        tmstmps->data[(tmstmps->nrecords)++] = timestamp;
+    sd->current_timestamp = tmstmps->data;
+
+END:
+    kmerge_free(&km);
+    return result;
+
+GENFAIL:
+    result = errno;
+    goto END;
+}
+
 static void tsie_end(struct state_data *sd);
 static void tsie_not_in_event(struct state_data *sd);
 static void tsie_start_event(struct state_data *sd);
 static void tsie_in_event(struct state_data *sd);
 static void tsie_maybe_end_of_event(struct state_data *sd);
+static void tsie_check_separation(struct state_data *sd);
 
 static void tsie_start(struct state_data *sd)
 {
-    struct timeseries *tmstmps;
-    struct timeseries **tp;
-    struct ts_record *r1;
-    struct ts_record *r2;
-    struct ts_record *end_record;
-
     sd->result = 0; /* This will always stay at zero until we find an error. */
-
-    /* all_timestamps is a dummy time series that is used to hold all the time
-     * stamps of all the time series.
-     */
-    if((sd->all_timestamps = ts_create())==NULL) {
-        *(sd->errstr) = strerror(errno);
-        sd->result = errno;
-        sd->state = tsie_end;
-        return;
-    }
-    tmstmps = sd->all_timestamps;
-    for(tp = sd->ts->ts; tp < sd->ts->ts + sd->ts->n; ++tp)
-        if((sd->result = ts_merge_anyway(tmstmps, *tp, sd->errstr))) {
-            sd->state = tsie_end;
-            return;
-        }
-    r1 = ts_get_next(tmstmps, sd->range.start_date);
-    r2 = ts_get_prev(tmstmps, sd->range.end_date);
-    end_record = tmstmps->data + (tmstmps->nrecords - 1);
-    if(r2<end_record)
-		if(ts_delete_records(tmstmps, r2+1, end_record)==NULL)
-			goto INTERN_ERROR;
-    if(r1>tmstmps->data)
-    	if(ts_delete_records(tmstmps, tmstmps->data, r1-1)==NULL)
-    		goto INTERN_ERROR;
-    if(!tmstmps->nrecords) {
+    sd->resume = tsie_not_in_event;
+    if((sd->result = merge_timestamps(sd, sd->range.start_date,
+                                                    sd->range.end_date))) {
+        *(sd->errstr) = strerror(sd->result);
         sd->state = tsie_end;
         return;
     }
-    sd->current_record = tmstmps->data;
-    sd->state = tsie_not_in_event;
-    return;
+    sd->state = sd->all_timestamps->nrecords ? tsie_not_in_event : tsie_end;
+}
 
-INTERN_ERROR:
-    *(sd->errstr) = "Internal error in tsie_start";
-    sd->result = 255;
+/* Called by the states when they run out of timestamps; "resume" is the
+ * state with which to continue if more timestamps are supplied later.
+ */
+static void tsie_out_of_timestamps(struct state_data *sd,
+                                        void (*resume)(struct state_data *))
+{
+    sd->resume = resume;
     sd->state = tsie_end;
 }
 
 static void tsie_not_in_event(struct state_data *sd)
 {
-    struct timeseries *tmstmps = sd->all_timestamps;
-    while(sd->current_record < tmstmps->data + tmstmps->nrecords) {
-        int i = num_of_timeseries_crossing_threshold(sd, sd->start_threshold);
+    struct datetimelist *tmstmps = sd->all_timestamps;
+    while(sd->current_timestamp < tmstmps->data + tmstmps->nrecords) {
+        int index = sd->current_timestamp - tmstmps->data;
+        int i;
+        if(sd->sync && sd->sync[index]) {
+            sd->synced = 1;
+            sd->state = tsie_end;
+            return;
+        }
+        if(sd->quiet)
+            sd->quiet[index] = 1;
+        i = num_of_timeseries_crossing_threshold(sd, sd->start_threshold);
         if(i >= sd->ntimeseries_start_threshold) {
             sd->state = tsie_start_event;
             return;
         }
-        ++(sd->current_record);
+        ++(sd->current_timestamp);
     }
-    sd->state = tsie_end;
+    tsie_out_of_timestamps(sd, tsie_not_in_event);
 }
 
 static void tsie_start_event(struct state_data *sd)
 {
-    long_time_t t = sd->current_record->timestamp;
+    long_time_t t = *(sd->current_timestamp);
     int err = il_append(sd->events, t, t);
     if(err) {
         sd->result = errno;
@@ -829,45 +1366,86 @@ static void tsie_start_event(struct state_data *sd)
 static void tsie_in_event(struct state_data *sd)
 {
     struct interval *current_event = sd->events->intervals + sd->events->n - 1;
-    struct timeseries *tmstmps = sd->all_timestamps;
-    while(sd->current_record < tmstmps->data + tmstmps->nrecords) {
+    struct datetimelist *tmstmps = sd->all_timestamps;
+    while(sd->current_timestamp < tmstmps->data + tmstmps->nrecords) {
         int i = num_of_timeseries_crossing_threshold(sd, sd->end_threshold);
         if(i < sd->ntimeseries_end_threshold) {
             sd->state = tsie_maybe_end_of_event;
             return;
         }
-        current_event->end_date = sd->current_record->timestamp;
-        ++(sd->current_record);
+        current_event->end_date = *(sd->current_timestamp);
+        ++(sd->current_timestamp);
     }
-    sd->state = tsie_end;
+    tsie_out_of_timestamps(sd, tsie_in_event);
 }
 
 static void tsie_maybe_end_of_event(struct state_data *sd)
 {
     struct interval *current_event = sd->events->intervals + sd->events->n - 1;
-    struct timeseries *tmstmps = sd->all_timestamps;
-    while(sd->current_record < tmstmps->data + tmstmps->nrecords) {
+    struct datetimelist *tmstmps = sd->all_timestamps;
+    while(sd->current_timestamp < tmstmps->data + tmstmps->nrecords) {
         int i = num_of_timeseries_crossing_threshold(sd, sd->end_threshold);
         if(i >= sd->ntimeseries_end_threshold) {
             sd->state = tsie_in_event;
             return;
         }
-        if((++(sd->current_record))->timestamp - current_event->end_date >=
+        if(++(sd->current_timestamp) < tmstmps->data + tmstmps->nrecords
+                && *(sd->current_timestamp) - current_event->end_date >=
                                                         sd->time_separator) {
             sd->state = tsie_not_in_event;
             return;
         }
     }
-    sd->state = tsie_end;
+    tsie_out_of_timestamps(sd, tsie_check_separation);
+}
+
+/* Entered when tsie_maybe_end_of_event ran out of timestamps right after
+ * advancing; performs its time separator check on the next timestamp.
+ */
+static void tsie_check_separation(struct state_data *sd)
+{
+    struct interval *current_event = sd->events->intervals + sd->events->n - 1;
+    struct datetimelist *tmstmps = sd->all_timestamps;
+    if(sd->current_timestamp >= tmstmps->data + tmstmps->nrecords)
+        tsie_out_of_timestamps(sd, tsie_check_separation);
+    else if(*(sd->current_timestamp) - current_event->end_date >=
+                                                        sd->time_separator)
+        sd->state = tsie_not_in_event;
+    else
+        sd->state = tsie_maybe_end_of_event;
 }
 
 static void tsie_end(struct state_data *sd)
 {
-    ts_free(sd->all_timestamps);
     sd->state = NULL;
 }
 
-DLLEXPORT int ts_identify_events(struct timeseries_list *ts, 
+static void init_state_data(struct state_data *sd,
+    const struct timeseries_list *ts, struct interval range, int reverse,
+    double start_threshold, double end_threshold,
+    int ntimeseries_start_threshold, int ntimeseries_end_threshold,
+    long_time_t time_separator, struct interval_list *events, char **errstr)
+{
+    sd->all_timestamps = NULL;
+    sd->cursors = NULL;
+    sd->quiet = NULL;
+    sd->sync = NULL;
+    sd->synced = 0;
+    sd->result = 0;
+    sd->resume = tsie_not_in_event;
+    sd->ts = ts;
+    sd->range = range;
+    sd->reverse = reverse;
+    sd->start_threshold = start_threshold;
+    sd->end_threshold = end_threshold;
+    sd->ntimeseries_start_threshold = ntimeseries_start_threshold;
+    sd->ntimeseries_end_threshold = ntimeseries_end_threshold;
+    sd->time_separator = time_separator;
+    sd->events = events;
+    sd->errstr = errstr;
+}
+
+DLLEXPORT int ts_identify_events(const struct timeseries_list *ts,
     struct interval range, int reverse, double start_threshold,
     double end_threshold, int ntimeseries_start_threshold,
     int ntimeseries_end_threshold, long_time_t time_separator,
@@ -875,22 +1453,255 @@ DLLEXPORT int ts_identify_events(struct timeseries_list *ts,
 {
     struct state_data state_data;
 
-    state_data.all_timestamps = ts_create();
-    state_data.ts = ts;
-    state_data.range = range;
-    state_data.reverse = reverse;
-    state_data.start_threshold = start_threshold;
-    state_data.end_threshold = end_threshold;
-    state_data.ntimeseries_start_threshold = ntimeseries_start_threshold;
-    state_data.ntimeseries_end_threshold = ntimeseries_end_threshold;
-    state_data.time_separator = time_separator;
-    state_data.events = events;
-    state_data.errstr = errstr;
-
+    init_state_data(&state_data, ts, range, reverse, start_threshold,
+            end_threshold, ntimeseries_start_threshold,
+            ntimeseries_end_threshold, time_separator, events, errstr);
     state_data.state = tsie_start;
     while(state_data.state)
         (*(state_data.state))(&state_data);
+    if(state_data.all_timestamps)
+        dl_free(state_data.all_timestamps);
+    free(state_data.cursors);
     return state_data.result;
 }
     
+/* Parallel event detection. The range is split into time partitions, one
+ * per thread, and the state machine is run on each partition as if no event
+ * were in progress at its start, marking the timestamps examined while not in
+ * event as quiet. The partitions are then joined in order: the state reached
+ * at the end of the previous partition is continued into the next one until
+ * it examines, while not in event, a timestamp that was also quiet in the
+ * partition's own run; from there on the two runs are identical, so the
+ * partition's remaining events are used as they are. Usually only the event
+ * crossing the boundary (including its time_separator tail) is evaluated
+ * twice.
+ */
+
+struct tsie_partition {
+    struct state_data sd;
+    char *errstr;
+};
+
+static void tsie_partition_task(void *arg, int i)
+{
+    struct state_data *sd = &((struct tsie_partition *) arg)[i].sd;
+    int n;
+
+    if((sd->result = merge_timestamps(sd, sd->range.start_date,
+                                                        sd->range.end_date)))
+        return;
+    n = sd->all_timestamps->nrecords;
+    if(n && !(sd->quiet = calloc(n, 1))) {
+        sd->result = errno;
+        return;
+    }
+    sd->state = tsie_not_in_event;
+    while(sd->state)
+        (*(sd->state))(sd);
+}
+
+/* Continues sd, which has reached the start of partition p, into p. */
+static int tsie_join(struct state_data *sd, struct tsie_partition *p)
+{
+    struct interval_list *pevents = p->sd.events;
+    long_time_t t;
+    int i;
+
+    sd->all_timestamps = p->sd.all_timestamps;
+    sd->current_timestamp = sd->all_timestamps->data;
+    for(i = 0; i < sd->ts->n; ++i) {
+        struct timeseries *ts = sd->ts->ts[i];
+        sd->cursors[i] = ts_get_next_i(ts, p->sd.range.start_date);
+        if(sd->cursors[i] < 0)
+            sd->cursors[i] = ts->nrecords;
+    }
+    sd->sync = p->sd.quiet;
+    sd->synced = 0;
+    sd->state = sd->resume;
+    while(sd->state)
+        (*(sd->state))(sd);
+    sd->all_timestamps = NULL;
+    if(sd->result || !sd->synced)
+        return sd->result;
+    t = *(sd->current_timestamp);
+    for(i = 0; i < pevents->n; ++i) {
+        struct interval *e = pevents->intervals + i;
+        if(e->start_date >= t
+                    && il_append(sd->events, e->start_date, e->end_date)) {
+            *(sd->errstr) = strerror(errno);
+            return sd->result = errno;
+        }
+    }
+    sd->resume = p->sd.resume;
+    return 0;
+}
+
+DLLEXPORT int ts_identify_events_parallel(const struct timeseries_list *ts,
+    struct interval range, int reverse, double start_threshold,
+    double end_threshold, int ntimeseries_start_threshold,
+    int ntimeseries_end_threshold, long_time_t time_separator,
+    struct interval_list *events, char **errstr)
+{
+    struct state_data state_data;
+    struct tsie_partition *parts = NULL;
+    struct timeseries *longest = NULL;
+    int nparts = dickinson_get_threads();
+    int i, first = 0, count = 0, total = 0;
+    int result = 0;
+
+    for(i = 0; i < ts->n; ++i) {
+        struct timeseries *t = ts->ts[i];
+        int i1 = ts_get_next_i(t, range.start_date);
+        int i2 = ts_get_prev_i(t, range.end_date);
+        if(i1 < 0 || i2 < i1)
+            continue;
+        total += i2 - i1 + 1;
+        if(i2 - i1 + 1 > count) {
+            longest = t;
+            first = i1;
+            count = i2 - i1 + 1;
+        }
+    }
+    if(!parallel_worthwhile(total) || count < nparts)
+        return ts_identify_events(ts, range, reverse, start_threshold,
+                end_threshold, ntimeseries_start_threshold,
+                ntimeseries_end_threshold, time_separator, events, errstr);
+
+    init_state_data(&state_data, ts, range, reverse, start_threshold,
+            end_threshold, ntimeseries_start_threshold,
+            ntimeseries_end_threshold, time_separator, events, errstr);
+    if(!(parts = malloc(nparts * sizeof(struct tsie_partition))))
+        goto GENFAIL;
+    for(i = 0; i < nparts; ++i)
+        init_state_data(&parts[i].sd, ts, range, reverse, start_threshold,
+                end_threshold, ntimeseries_start_threshold,
+                ntimeseries_end_threshold, time_separator, NULL,
+                &parts[i].errstr);
+    /* The partition boundaries divide the records of the longest time series
+     * in range into equal parts.
+     */
+    for(i = 1; i < nparts; ++i) {
+        int j = first + (int) ((long long) count * i / nparts);
+        long_time_t t = longest->data[j].timestamp;
+        parts[i].sd.range.start_date = t;
+        parts[i-1].sd.range.end_date = t - 1;
+    }
+    for(i = 0; i < nparts; ++i)
+        if(!(parts[i].sd.events = il_create()))
+            goto GENFAIL;
+    if(ts->n && !(state_data.cursors = malloc(ts->n * sizeof(int))))
+        goto GENFAIL;
+
+    parallel_run(nparts, tsie_partition_task, parts);
+
+    for(i = 0; i < nparts; ++i)
+        if((result = parts[i].sd.result)) {
+            *errstr = strerror(result);
+            goto END;
+        }
+    for(i = 0; i < nparts; ++i)
+        if((result = tsie_join(&state_data, parts + i)))
+            goto END;
+
+END:
+    if(parts)
+        for(i = 0; i < nparts; ++i) {
+            if(parts[i].sd.all_timestamps)
+                dl_free(parts[i].sd.all_timestamps);
+            free(parts[i].sd.cursors);
+            free(parts[i].sd.quiet);
+            if(parts[i].sd.events)
+                il_free(parts[i].sd.events);
+        }
+    free(parts);
+    free(state_data.cursors);
+    return result;
+
+GENFAIL:
+    result = errno;
+    *errstr = strerror(errno);
+    goto END;
+}
+
+/* Event detector: the state machine of ts_identify_events, kept between
+ * calls.
+ */
+
+struct event_detector {
+    struct state_data sd;
+    int started;                /* Whether any timestamp has been examined */
+    long_time_t last_timestamp; /* The last timestamp examined */
+    char *errstr;
+};
+
+DLLEXPORT struct event_detector *ed_create(struct timeseries_list *ts,
+    int reverse, double start_threshold, double end_threshold,
+    int ntimeseries_start_threshold, int ntimeseries_end_threshold,
+    long_time_t time_separator, struct interval_list *events)
+{
+    struct event_detector *ed = malloc(sizeof(struct event_detector));
+    struct interval range;
+    if(!ed)
+        return NULL;
+    ed->started = 0;
+    ed->last_timestamp = LONG_TIME_T_MIN;
+    ed->errstr = NULL;
+    range.start_date = LONG_TIME_T_MIN;
+    range.end_date = LONG_TIME_T_MAX;
+    init_state_data(&ed->sd, ts, range, reverse, start_threshold,
+            end_threshold, ntimeseries_start_threshold,
+            ntimeseries_end_threshold, time_separator, events, &ed->errstr);
+    return ed;
+}
+
+DLLEXPORT void ed_free(struct event_detector *ed)
+{
+    if(!ed)
+        return;
+    if(ed->sd.all_timestamps)
+        dl_free(ed->sd.all_timestamps);
+    free(ed->sd.cursors);
+    free(ed);
+}
+
+DLLEXPORT int ed_update(struct event_detector *ed, long_time_t end_date,
+                                        int *first_changed, char **errstr)
+{
+    struct state_data *sd = &ed->sd;
+    struct datetimelist *tmstmps;
+    long_time_t start_date = ed->last_timestamp;
+    long_time_t last_end = 0;
+    int nevents = sd->events->n;
+
+    if(nevents)
+        last_end = sd->events->intervals[nevents-1].end_date;
+    if(first_changed)
+        *first_changed = nevents;
+    if(ed->started) {
+        if(start_date >= end_date)
+            return 0;
+        ++start_date;
+    }
+    if((sd->result = merge_timestamps(sd, start_date, end_date))) {
+        *errstr = strerror(sd->result);
+        return sd->result;
+    }
+    tmstmps = sd->all_timestamps;
+    if(!tmstmps->nrecords)
+        return 0;
+    ed->started = 1;
+    ed->last_timestamp = tmstmps->data[tmstmps->nrecords-1];
+    sd->state = sd->resume;
+    while(sd->state)
+        (*(sd->state))(sd);
+    if(sd->result) {
+        *errstr = ed->errstr;
+        return sd->result;
+    }
+    if(first_changed && nevents
+                && sd->events->intervals[nevents-1].end_date != last_end)
+        *first_changed = nevents - 1;
+    return 0;
+}
+
 /* end ts_identify_events */
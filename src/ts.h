@@ -34,15 +34,29 @@ struct ts_record {
     char *flags;
 };
 
+struct ts_sum_index;
+struct ts_minmax_index;
+struct ts_quantile_index;
+struct search_index;
+
 struct timeseries {
     struct ts_record *data; /* Dyn mem block containing timeseries records */
     int nrecords; /* Size of time series (number of records) */
     size_t memblocksize; /* Size of the dynamic memory block in bytes. */
+    struct ts_sum_index *sum_index; /* Optional, see tsindex.h */
+    struct ts_minmax_index *minmax_index; /* Optional, see tsindex.h */
+    struct ts_quantile_index *quantile_index; /* Optional, see tsindex.h */
+    int offset; /* Number of records trimmed from the start of the memory
+                   block; data points after them, so the block is at
+                   data - offset, and memblocksize includes them. Zero when
+                   there are no records and after ts_compact. */
+    struct search_index *search_index; /* Optional, see tsindex.h */
 };
 
 struct timeseries_list {
     struct timeseries **ts;
     int n;
+    int size; /* Number of allocated pointers */
 };
 
 extern DLLEXPORT int ts_append_record(struct timeseries *ts,
@@ -64,6 +78,10 @@ extern DLLEXPORT struct ts_record *ts_get(const struct timeseries *ts,
 extern DLLEXPORT int ts_get_i(const struct timeseries *ts,
                                                         long_time_t timestamp);
 extern DLLEXPORT int ts_delete_record(struct timeseries *ts, long_time_t tm);
+extern DLLEXPORT int ts_delete_range(struct timeseries *ts,
+                            long_time_t start_date, long_time_t end_date);
+extern DLLEXPORT int ts_trim_head(struct timeseries *ts, long_time_t before);
+extern DLLEXPORT void ts_compact(struct timeseries *ts);
 extern DLLEXPORT int ts_delete_item(struct timeseries *ts, int index);
 extern DLLEXPORT struct ts_record *ts_delete_records(struct timeseries *ts,
                                    struct ts_record *r1, struct ts_record *r2);
@@ -82,8 +100,22 @@ extern DLLEXPORT int ts_readfromstring(char *string, struct timeseries *ts,
                                                   int *errline, char **errstr);
 extern DLLEXPORT int ts_merge(struct timeseries *ts1, struct timeseries *ts2, 
                                                                 char **errstr);
+extern DLLEXPORT int ts_merge_move(struct timeseries *ts1,
+                                    struct timeseries *ts2, char **errstr);
+extern DLLEXPORT void ts_swap(struct timeseries *ts1, struct timeseries *ts2);
+extern DLLEXPORT int ts_steal_range(struct timeseries *dest,
+    struct timeseries *src, long_time_t start_date, long_time_t end_date,
+    char **errstr);
 extern DLLEXPORT int ts_merge_anyway(struct timeseries *ts1,
                                   const struct timeseries *ts2, char **errstr);
+
+/* Policies of ts_upsert_batch for records that already exist */
+#define TS_UPSERT_INSERT 0
+#define TS_UPSERT_OVERWRITE 1
+#define TS_UPSERT_SKIP 2
+
+extern DLLEXPORT int ts_upsert_batch(struct timeseries *ts,
+    const struct ts_record *records, int n, int policy, char **errstr);
 extern DLLEXPORT int ts_writeline(struct ts_record *r, int precision, char *str,
                                                         size_t max_length);
 extern DLLEXPORT char *ts_write(struct timeseries *ts, int precision,
@@ -93,18 +125,58 @@ extern DLLEXPORT void tsl_free(struct timeseries_list *tsl);
 extern DLLEXPORT int tsl_append(struct timeseries_list *tsl, struct timeseries
                                                                     *t);
 extern DLLEXPORT int tsl_delete(struct timeseries_list *tsl, int index);
-extern DLLEXPORT double ts_min(struct timeseries *ts, long_time_t start_date,
-                                                        long_time_t end_date);
-extern DLLEXPORT double ts_max(struct timeseries *ts, long_time_t start_date,
-                                                        long_time_t end_date);
-extern DLLEXPORT double ts_average(struct timeseries *ts,
+/* These do not modify the time series, but they bring its attached sum,
+ * minmax or quantile index (which are caches) up to date; see tsindex.h.
+ */
+extern DLLEXPORT double ts_min(const struct timeseries *ts,
+                                long_time_t start_date, long_time_t end_date);
+extern DLLEXPORT double ts_max(const struct timeseries *ts,
                                 long_time_t start_date, long_time_t end_date);
-extern DLLEXPORT double ts_sum(struct timeseries *ts, long_time_t start_date,
-                                                        long_time_t end_date);
-extern DLLEXPORT int ts_identify_events(struct timeseries_list *ts,
+extern DLLEXPORT double ts_average(const struct timeseries *ts,
+                                long_time_t start_date, long_time_t end_date);
+extern DLLEXPORT double ts_sum(const struct timeseries *ts,
+                                long_time_t start_date, long_time_t end_date);
+extern DLLEXPORT int ts_count(const struct timeseries *ts,
+                                long_time_t start_date, long_time_t end_date);
+extern DLLEXPORT int ts_identify_events(const struct timeseries_list *ts,
     struct interval range, int reverse,
     double start_threshold, double end_threshold,
     int ntimeseries_start_threshold, int ntimeseries_end_threshold,
     long_time_t time_separator, struct interval_list *events, char **errstr);
+extern DLLEXPORT int ts_identify_events_parallel(
+    const struct timeseries_list *ts, struct interval range, int reverse,
+    double start_threshold, double end_threshold,
+    int ntimeseries_start_threshold, int ntimeseries_end_threshold,
+    long_time_t time_separator, struct interval_list *events, char **errstr);
+
+/* A position in a time series, from -1 (before the first record) to
+ * nrecords (after the last). Searches start from the current position.
+ */
+struct ts_cursor {
+    const struct timeseries *ts;
+    int index;
+};
+
+extern DLLEXPORT void ts_cursor_init(struct ts_cursor *c,
+                                                const struct timeseries *ts);
+extern DLLEXPORT struct ts_record *ts_cursor_get(const struct ts_cursor *c);
+extern DLLEXPORT struct ts_record *ts_cursor_next(struct ts_cursor *c);
+extern DLLEXPORT struct ts_record *ts_cursor_prev(struct ts_cursor *c);
+extern DLLEXPORT struct ts_record *ts_cursor_seek(struct ts_cursor *c,
+                                                        long_time_t timestamp);
+extern DLLEXPORT struct ts_record *ts_cursor_seek_next(struct ts_cursor *c,
+                                                        long_time_t timestamp);
+extern DLLEXPORT struct ts_record *ts_cursor_seek_prev(struct ts_cursor *c,
+                                                        long_time_t timestamp);
+
+/* Incremental event detection; see ts_identify_events. */
+struct event_detector;
+extern DLLEXPORT struct event_detector *ed_create(struct timeseries_list *ts,
+    int reverse, double start_threshold, double end_threshold,
+    int ntimeseries_start_threshold, int ntimeseries_end_threshold,
+    long_time_t time_separator, struct interval_list *events);
+extern DLLEXPORT int ed_update(struct event_detector *ed,
+                    long_time_t end_date, int *first_changed, char **errstr);
+extern DLLEXPORT void ed_free(struct event_detector *ed);
 
 #endif /* _TS_H */
@@ -0,0 +1,521 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * tsindex.c - optional indexes attached to time series
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <math.h>
+#include "ts.h"
+#include "tsindex.h"
+#include "quantile.h"
+#include "search.h"
+#include "platform.h"
+
+/* Sum index */
+
+static void free_sum_index(struct ts_sum_index *si)
+{
+    if(!si) return;
+    free(si->sum);
+    free(si->err);
+    free(si->count);
+    free(si->nonfinite);
+    free(si);
+}
+
+/* Makes sure there is room for nentries entries. Grows geometrically, since
+ * the index follows the time series as it is being appended to.
+ */
+static int sum_index_reserve(struct ts_sum_index *si, int nentries)
+{
+    void *p;
+    int size;
+
+    if(si->size >= nentries)
+        return 0;
+    size = si->size ? si->size : 16;
+    while(size < nentries)
+        size *= 2;
+    if(!(p = realloc(si->sum, size*sizeof(double)))) return errno;
+    si->sum = p;
+    if(!(p = realloc(si->err, size*sizeof(double)))) return errno;
+    si->err = p;
+    if(!(p = realloc(si->count, size*sizeof(int)))) return errno;
+    si->count = p;
+    if(!(p = realloc(si->nonfinite, size*sizeof(int)))) return errno;
+    si->nonfinite = p;
+    si->size = size;
+    return 0;
+}
+
+/* Brings entries up to and including entry "upto" up to date. */
+static int sum_index_update(const struct timeseries *ts, int upto)
+{
+    struct ts_sum_index *si = ts->sum_index;
+    int i, r;
+
+    if(upto <= si->nvalid)
+        return 0;
+    if((r = sum_index_reserve(si, ts->nrecords + 1)))
+        return r;
+    for(i = si->nvalid; i < upto; ++i) {
+        struct ts_record *rec = ts->data + i;
+        double s = si->sum[i];
+        double t;
+
+        si->err[i+1] = si->err[i];
+        si->count[i+1] = si->count[i];
+        si->nonfinite[i+1] = si->nonfinite[i];
+        si->sum[i+1] = s;
+        if(rec->null)
+            continue;
+        ++(si->count[i+1]);
+        t = s + rec->value;
+        if(!isfinite(t)) {
+            ++(si->nonfinite[i+1]);
+            continue;
+        }
+        if(fabs(s) >= fabs(rec->value))
+            si->err[i+1] += (s - t) + rec->value;
+        else
+            si->err[i+1] += (rec->value - t) + s;
+        si->sum[i+1] = t;
+    }
+    si->nvalid = upto;
+    return 0;
+}
+
+DLLEXPORT int ts_attach_sum_index(struct timeseries *ts)
+{
+    struct ts_sum_index *si;
+    int r;
+
+    if(ts->sum_index)
+        return 0;
+    if(!(si = calloc(1, sizeof(struct ts_sum_index))))
+        return errno;
+    if((r = sum_index_reserve(si, ts->nrecords + 1))) {
+        free_sum_index(si);
+        return r;
+    }
+    si->sum[0] = si->err[0] = 0.0;
+    si->count[0] = si->nonfinite[0] = 0;
+    ts->sum_index = si;
+    return sum_index_update(ts, ts->nrecords);
+}
+
+DLLEXPORT void ts_detach_sum_index(struct timeseries *ts)
+{
+    free_sum_index(ts->sum_index);
+    ts->sum_index = NULL;
+}
+
+int tsindex_range_sum(const struct timeseries *ts, int i1, int i2, double *sum,
+                                                                int *count)
+{
+    struct ts_sum_index *si = ts->sum_index;
+    int r;
+
+    if((r = sum_index_update(ts, i2 + 1)))
+        return r;
+    *count = si->count[i2+1] - si->count[i1];
+    if(si->nonfinite[i2+1] == si->nonfinite[i1]) {
+        *sum = (si->sum[i2+1] - si->sum[i1]) + (si->err[i2+1] - si->err[i1]);
+        if(isfinite(*sum))
+            return 0;
+    }
+    *sum = 0.0;
+    for(r = i1; r <= i2; ++r)
+        if(!ts->data[r].null)
+            *sum += ts->data[r].value;
+    return 0;
+}
+
+/* Minmax index */
+
+static void free_minmax_index(struct ts_minmax_index *mi)
+{
+    int k;
+
+    if(!mi) return;
+    for(k = 0; k < TS_MINMAX_LEVELS; ++k) {
+        free(mi->min[k]);
+        free(mi->max[k]);
+    }
+    free(mi);
+}
+
+static double record_value(const struct ts_record *r)
+{
+    return r->null ? NAN : r->value;
+}
+
+static int floor_log2(int n)
+{
+    int k = 0;
+    while(n >>= 1)
+        ++k;
+    return k;
+}
+
+/* Makes sure there is room for nrecords records. Existing contents are
+ * preserved in sparse mode; in segment tree mode they are lost, because the
+ * leaves move, and the caller must rebuild.
+ */
+static int minmax_index_reserve(struct ts_minmax_index *mi, int nrecords)
+{
+    void *p;
+    int capacity, k, nlevels, nentries;
+
+    if(mi->capacity >= nrecords && mi->capacity > 0)
+        return 0;
+    capacity = mi->capacity ? mi->capacity : 16;
+    while(capacity < nrecords)
+        capacity *= 2;
+    if(mi->mode == TS_MINMAX_SEGTREE) {
+        nlevels = 1;
+        nentries = 2 * capacity;
+    } else {
+        nlevels = floor_log2(capacity) + 1;
+        nentries = capacity;
+    }
+    for(k = 0; k < nlevels; ++k) {
+        if(!(p = realloc(mi->min[k], nentries*sizeof(double)))) return errno;
+        mi->min[k] = p;
+        if(!(p = realloc(mi->max[k], nentries*sizeof(double)))) return errno;
+        mi->max[k] = p;
+    }
+    mi->capacity = capacity;
+    return 0;
+}
+
+/* Sets leaf i of the segment tree and recomputes its ancestors. */
+static void segtree_set(struct ts_minmax_index *mi, int i, double value)
+{
+    double *tmin = mi->min[0];
+    double *tmax = mi->max[0];
+
+    i += mi->capacity;
+    tmin[i] = tmax[i] = value;
+    for(i /= 2; i >= 1; i /= 2) {
+        tmin[i] = fmin(tmin[2*i], tmin[2*i+1]);
+        tmax[i] = fmax(tmax[2*i], tmax[2*i+1]);
+    }
+}
+
+/* Adds to the sparse table the entries that end at record i, which must be
+ * the record following the last one already in the table.
+ */
+static void sparse_append(struct ts_minmax_index *mi, int i, double value)
+{
+    int k, j, half;
+
+    mi->min[0][i] = mi->max[0][i] = value;
+    for(k = 1; (1 << k) <= i + 1; ++k) {
+        j = i - (1 << k) + 1;
+        half = 1 << (k-1);
+        mi->min[k][j] = fmin(mi->min[k-1][j], mi->min[k-1][j+half]);
+        mi->max[k][j] = fmax(mi->max[k-1][j], mi->max[k-1][j+half]);
+    }
+}
+
+static int minmax_index_rebuild(const struct timeseries *ts)
+{
+    struct ts_minmax_index *mi = ts->minmax_index;
+    int i, r;
+
+    mi->capacity = mi->mode == TS_MINMAX_SEGTREE ? 0 : mi->capacity;
+    if((r = minmax_index_reserve(mi, ts->nrecords)))
+        return r;
+    if(mi->mode == TS_MINMAX_SEGTREE) {
+        double *tmin = mi->min[0];
+        double *tmax = mi->max[0];
+        for(i = 0; i < mi->capacity; ++i)
+            tmin[mi->capacity+i] = tmax[mi->capacity+i] =
+                    i < ts->nrecords ? record_value(ts->data + i) : NAN;
+        for(i = mi->capacity - 1; i >= 1; --i) {
+            tmin[i] = fmin(tmin[2*i], tmin[2*i+1]);
+            tmax[i] = fmax(tmax[2*i], tmax[2*i+1]);
+        }
+    } else {
+        for(i = 0; i < ts->nrecords; ++i)
+            sparse_append(mi, i, record_value(ts->data + i));
+    }
+    mi->nbuilt = ts->nrecords;
+    mi->dirty = 0;
+    return 0;
+}
+
+/* Brings the index up to date, extending it with any records appended since
+ * it was last used, or rebuilding it if it has been invalidated.
+ */
+static int minmax_index_update(const struct timeseries *ts)
+{
+    struct ts_minmax_index *mi = ts->minmax_index;
+    int i, r;
+
+    if(mi->dirty || mi->nbuilt > ts->nrecords)
+        return minmax_index_rebuild(ts);
+    if(mi->nbuilt == ts->nrecords)
+        return 0;
+    if(ts->nrecords > mi->capacity) {
+        if(mi->mode == TS_MINMAX_SEGTREE)
+            return minmax_index_rebuild(ts);
+        if((r = minmax_index_reserve(mi, ts->nrecords)))
+            return r;
+    }
+    for(i = mi->nbuilt; i < ts->nrecords; ++i)
+        if(mi->mode == TS_MINMAX_SEGTREE)
+            segtree_set(mi, i, record_value(ts->data + i));
+        else
+            sparse_append(mi, i, record_value(ts->data + i));
+    mi->nbuilt = ts->nrecords;
+    return 0;
+}
+
+DLLEXPORT int ts_attach_minmax_index(struct timeseries *ts, int mode)
+{
+    struct ts_minmax_index *mi;
+    int r;
+
+    if(mode != TS_MINMAX_SPARSE && mode != TS_MINMAX_SEGTREE)
+        return EINVAL;
+    if(ts->minmax_index) {
+        if(ts->minmax_index->mode == mode)
+            return 0;
+        ts_detach_minmax_index(ts);
+    }
+    if(!(mi = calloc(1, sizeof(struct ts_minmax_index))))
+        return errno;
+    mi->mode = mode;
+    ts->minmax_index = mi;
+    if((r = minmax_index_rebuild(ts))) {
+        ts_detach_minmax_index(ts);
+        return r;
+    }
+    return 0;
+}
+
+DLLEXPORT void ts_detach_minmax_index(struct timeseries *ts)
+{
+    free_minmax_index(ts->minmax_index);
+    ts->minmax_index = NULL;
+}
+
+int tsindex_range_minmax(const struct timeseries *ts, int i1, int i2, double *min,
+                                                                double *max)
+{
+    struct ts_minmax_index *mi = ts->minmax_index;
+    int r, k;
+
+    if((r = minmax_index_update(ts)))
+        return r;
+    if(mi->mode == TS_MINMAX_SEGTREE) {
+        double *tmin = mi->min[0];
+        double *tmax = mi->max[0];
+        *min = *max = NAN;
+        for(i1 += mi->capacity, i2 += mi->capacity + 1; i1 < i2;
+                                                        i1 /= 2, i2 /= 2) {
+            if(i1 & 1) {
+                *min = fmin(*min, tmin[i1]);
+                *max = fmax(*max, tmax[i1++]);
+            }
+            if(i2 & 1) {
+                *min = fmin(*min, tmin[--i2]);
+                *max = fmax(*max, tmax[i2]);
+            }
+        }
+    } else {
+        k = floor_log2(i2 - i1 + 1);
+        *min = fmin(mi->min[k][i1], mi->min[k][i2 - (1 << k) + 1]);
+        *max = fmax(mi->max[k][i1], mi->max[k][i2 - (1 << k) + 1]);
+    }
+    return 0;
+}
+
+/* Quantile index */
+
+DLLEXPORT int ts_attach_quantile_index(struct timeseries *ts, int block_size,
+                                                        double compression)
+{
+    struct ts_quantile_index *qi;
+
+    if(block_size < 1)
+        return EINVAL;
+    ts_detach_quantile_index(ts);
+    if(!(qi = calloc(1, sizeof(struct ts_quantile_index))))
+        return errno;
+    qi->block_size = block_size;
+    qi->compression = compression;
+    ts->quantile_index = qi;
+    return 0;
+}
+
+DLLEXPORT void ts_detach_quantile_index(struct timeseries *ts)
+{
+    struct ts_quantile_index *qi = ts->quantile_index;
+    int i;
+
+    if(!qi) return;
+    for(i = 0; i < qi->nblocks; ++i)
+        td_free(qi->blocks[i]);
+    free(qi->blocks);
+    free(qi);
+    ts->quantile_index = NULL;
+}
+
+/* Brings blocks 0..nblocks-1 up to date. */
+static int quantile_index_update(const struct timeseries *ts, int nblocks)
+{
+    struct ts_quantile_index *qi = ts->quantile_index;
+    struct ts_record *r, *end;
+    void *p;
+    int i;
+
+    if(nblocks > qi->nblocks) {
+        if(!(p = realloc(qi->blocks, nblocks * sizeof(struct tdigest *))))
+            return errno;
+        qi->blocks = p;
+        for(; qi->nblocks < nblocks; ++(qi->nblocks))
+            if(!(qi->blocks[qi->nblocks] = td_create(qi->compression)))
+                return errno;
+    }
+    for(i = qi->nvalid; i < nblocks; ++i) {
+        td_clear(qi->blocks[i]);
+        r = ts->data + i * qi->block_size;
+        for(end = r + qi->block_size; r < end; ++r)
+            if(!r->null)
+                td_add(qi->blocks[i], r->value, 1.0);
+        qi->nvalid = i + 1;
+    }
+    return 0;
+}
+
+int tsindex_range_digest(const struct timeseries *ts, int i1, int i2,
+                                                        struct tdigest *td)
+{
+    struct ts_quantile_index *qi = ts->quantile_index;
+    int bs = qi->block_size;
+    int b1 = (i1 + bs - 1) / bs;    /* First block fully in range */
+    int b2 = (i2 + 1) / bs;         /* Block after last fully in range */
+    int i, r;
+
+    if(b1 >= b2) {
+        for(i = i1; i <= i2; ++i)
+            if(!ts->data[i].null)
+                td_add(td, ts->data[i].value, 1.0);
+        return 0;
+    }
+    if(b2 > qi->nvalid && (r = quantile_index_update(ts, b2)))
+        return r;
+    for(i = i1; i < b1 * bs; ++i)
+        if(!ts->data[i].null)
+            td_add(td, ts->data[i].value, 1.0);
+    for(i = b1; i < b2; ++i)
+        td_merge(td, qi->blocks[i]);
+    for(i = b2 * bs; i <= i2; ++i)
+        if(!ts->data[i].null)
+            td_add(td, ts->data[i].value, 1.0);
+    return 0;
+}
+
+/* Search index */
+
+static int build_search_index(struct timeseries *ts)
+{
+    return search_build(ts->search_index, ts->data ? &ts->data->timestamp
+                            : NULL, sizeof(struct ts_record), ts->nrecords);
+}
+
+DLLEXPORT int ts_attach_search_index(struct timeseries *ts, int mode)
+{
+    int r;
+
+    if(mode != SEARCH_EYTZINGER && mode != SEARCH_INTERPOLATION)
+        return EINVAL;
+    ts_detach_search_index(ts);
+    if(!(ts->search_index = search_create(mode)))
+        return errno;
+    if((r = build_search_index(ts))) {
+        ts_detach_search_index(ts);
+        return r;
+    }
+    return 0;
+}
+
+DLLEXPORT void ts_detach_search_index(struct timeseries *ts)
+{
+    search_free(ts->search_index);
+    ts->search_index = NULL;
+}
+
+DLLEXPORT int ts_update_search_index(struct timeseries *ts)
+{
+    if(!ts->search_index)
+        return 0;
+    return search_update(ts->search_index, ts->data ? &ts->data->timestamp
+                            : NULL, sizeof(struct ts_record), ts->nrecords);
+}
+
+/* Common */
+
+static void invalidate_sum_and_quantile(struct timeseries *ts, int index)
+{
+    struct ts_quantile_index *qi = ts->quantile_index;
+
+    if(ts->sum_index && ts->sum_index->nvalid > index)
+        ts->sum_index->nvalid = index;
+    if(qi && qi->nvalid > index / qi->block_size)
+        qi->nvalid = index / qi->block_size;
+}
+
+void tsindex_records_changed(struct timeseries *ts, int index)
+{
+    invalidate_sum_and_quantile(ts, index);
+    if(ts->minmax_index && ts->minmax_index->nbuilt > index)
+        ts->minmax_index->dirty = 1;
+    if(ts->search_index)
+        search_changed(ts->search_index, index, ts->nrecords);
+}
+
+void tsindex_records_appended(struct timeseries *ts)
+{
+    if(ts->search_index)
+        search_appended(ts->search_index, &ts->data->timestamp,
+                                    sizeof(struct ts_record), ts->nrecords);
+}
+
+void tsindex_record_updated(struct timeseries *ts, int index)
+{
+    struct ts_minmax_index *mi = ts->minmax_index;
+
+    invalidate_sum_and_quantile(ts, index);
+    if(!mi || mi->dirty || index >= mi->nbuilt)
+        return;
+    if(mi->mode == TS_MINMAX_SEGTREE)
+        segtree_set(mi, index, record_value(ts->data + index));
+    else
+        mi->dirty = 1;
+}
+
+void tsindex_free(struct timeseries *ts)
+{
+    ts_detach_sum_index(ts);
+    ts_detach_minmax_index(ts);
+    ts_detach_quantile_index(ts);
+    ts_detach_search_index(ts);
+}
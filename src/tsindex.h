@@ -0,0 +1,134 @@
+/*
+ * openmeteo.org
+ * dickinson library
+ * tsindex.h - optional indexes attached to time series
+ *
+ * Copyright (c) 2026  National Technical University of Athens
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _TSINDEX_H
+
+#define _TSINDEX_H
+
+#include "platform.h"
+#include "ts.h"
+
+/* Prefix sums of the not-null values of a time series. Entry i refers to
+ * records 0..i-1, so the sum of records i1..i2 is entry i2+1 minus entry i1.
+ * The sums are kept as a pair (sum, err) with Neumaier compensation, so that
+ * subtracting two large prefixes does not lose the small range sum. Values
+ * that are infinite or NaN, or that would make the sum overflow, are left
+ * out of the sums and counted in nonfinite instead; ranges containing any
+ * are summed directly.
+ */
+struct ts_sum_index {
+    double *sum;
+    double *err;
+    int *count;   /* Number of not-null values */
+    int *nonfinite; /* Number of values left out of sum */
+    int nvalid;   /* Entries 0..nvalid are up to date */
+    int size;     /* Number of allocated entries */
+};
+
+/* Range minimum and maximum of the not-null values (null records are stored
+ * as NAN, which fmin and fmax ignore). In TS_MINMAX_SPARSE mode, min[k][i]
+ * is the minimum of records i..i+2^k-1 (a sparse table, O(1) queries). In
+ * TS_MINMAX_SEGTREE mode, min[0] is a segment tree with "capacity" leaves
+ * starting at min[0][capacity] (O(log n) queries and point updates).
+ */
+#define TS_MINMAX_SPARSE 0
+#define TS_MINMAX_SEGTREE 1
+#define TS_MINMAX_LEVELS 32
+
+struct ts_minmax_index {
+    int mode;
+    int nbuilt;     /* Records 0..nbuilt-1 are reflected in the index */
+    int dirty;      /* Must be rebuilt before next use */
+    int capacity;
+    double *min[TS_MINMAX_LEVELS];
+    double *max[TS_MINMAX_LEVELS];
+};
+
+/* Quantile digests of consecutive blocks of block_size records; a range
+ * query merges the digests of the blocks it covers and adds the remaining
+ * records individually.
+ */
+struct tdigest;
+
+struct ts_quantile_index {
+    int block_size;
+    double compression;
+    struct tdigest **blocks;
+    int nblocks;    /* Number of allocated digests */
+    int nvalid;     /* Blocks 0..nvalid-1 are up to date */
+};
+
+/* The sum, minmax and quantile indexes are caches, brought up to date by
+ * the queries that use them (ts_sum, ts_min, ts_quantile and so on). Those
+ * queries take a const time series, since they only write to the index it
+ * points to, but they may not run at once on the same time series from
+ * several threads while such an index is attached.
+ */
+extern DLLEXPORT int ts_attach_sum_index(struct timeseries *ts);
+extern DLLEXPORT void ts_detach_sum_index(struct timeseries *ts);
+extern DLLEXPORT int ts_attach_minmax_index(struct timeseries *ts, int mode);
+extern DLLEXPORT void ts_detach_minmax_index(struct timeseries *ts);
+extern DLLEXPORT int ts_attach_quantile_index(struct timeseries *ts,
+                                        int block_size, double compression);
+extern DLLEXPORT void ts_detach_quantile_index(struct timeseries *ts);
+
+/* Accelerates ts_get_next and the functions based on it; see search.h for
+ * the modes. Unlike the other indexes, it is never modified by searching,
+ * so that several threads may search at once. Appending keeps it up to
+ * date; other modifications make it stale (searches then fall back to
+ * binary search) until ts_update_search_index is called.
+ */
+extern DLLEXPORT int ts_attach_search_index(struct timeseries *ts, int mode);
+extern DLLEXPORT void ts_detach_search_index(struct timeseries *ts);
+extern DLLEXPORT int ts_update_search_index(struct timeseries *ts);
+
+/* Used internally by ts.c. */
+
+/* Notifies the attached indexes that records index and following may have
+ * changed (including insertion or removal of records).
+ */
+extern void tsindex_records_changed(struct timeseries *ts, int index);
+/* Notifies the attached indexes that the value of record index (but not its
+ * timestamp, nor any other record) has changed.
+ */
+extern void tsindex_record_updated(struct timeseries *ts, int index);
+/* Notifies the attached indexes that records have been appended. */
+extern void tsindex_records_appended(struct timeseries *ts);
+extern void tsindex_free(struct timeseries *ts);
+
+/* Returns in *sum and *count the sum and number of not-null values of
+ * records i1..i2, which must be valid indexes. Requires an attached sum
+ * index; returns nonzero on insufficient memory.
+ */
+extern int tsindex_range_sum(const struct timeseries *ts, int i1, int i2,
+                                                    double *sum, int *count);
+
+/* Returns in *min and *max the minimum and maximum of the not-null values
+ * of records i1..i2, or NAN. Requires an attached minmax index; returns
+ * nonzero on insufficient memory.
+ */
+extern int tsindex_range_minmax(const struct timeseries *ts, int i1, int i2,
+                                                    double *min, double *max);
+
+/* Adds to td the not-null values of records i1..i2. Requires an attached
+ * quantile index; returns nonzero on insufficient memory.
+ */
+extern int tsindex_range_digest(const struct timeseries *ts, int i1, int i2,
+                                                        struct tdigest *td);
+
+#endif /* _TSINDEX_H */